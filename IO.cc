@@ -1,6 +1,7 @@
 #include "IO.h"
+#include "gameboy/timeline.h"
 
-IO::IO() : win(nullptr), ren(nullptr), tex(nullptr) {
+IO::IO() : win(nullptr), ren(nullptr), tex(nullptr), audio_dev(0) {
 }
 
 IO::~IO() {
@@ -11,9 +12,33 @@ void IO::create() {
 	win = SDL_CreateWindow("GBM", 0, 0, 160*4, 144*4, SDL_WINDOW_SHOWN);
 	ren = SDL_CreateRenderer(win, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
 	tex = SDL_CreateTexture(ren, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, 160*4, 144*4);
+
+	SDL_AudioSpec want;
+	memset(&want, 0, sizeof(want));
+	want.freq = 44100;
+	want.format = AUDIO_S16SYS;
+	want.channels = 2;
+	want.samples = 1024;
+	want.callback = &IO::audio_callback;
+	want.userdata = this;
+	audio_dev = SDL_OpenAudioDevice(NULL, 0, &want, NULL, 0);
+	if(audio_dev) SDL_PauseAudioDevice(audio_dev, 0);
+}
+
+//Runs on the SDL audio thread, the ring is its only shared state
+void IO::audio_callback(void *userdata, Uint8 *stream, int len) {
+	IO *io = static_cast<IO*>(userdata);
+	int16_t *out = reinterpret_cast<int16_t*>(stream);
+	const size_t frames = len / (2 * sizeof(int16_t));
+	const size_t got = io->audio.read(out, frames);
+	memset(out + got*2, 0, (frames - got) * 2 * sizeof(int16_t)); //Underrun
 }
 
 void IO::destroy() {
+	if(audio_dev) {
+		SDL_CloseAudioDevice(audio_dev);
+		audio_dev = 0;
+	}
 	if(tex) {
 		SDL_DestroyTexture(tex);
 		tex = nullptr;
@@ -30,10 +55,14 @@ void IO::destroy() {
 
 void IO::flip() {
 	if(!ren) return;
-	SDL_SetRenderDrawColor(ren, White.r, White.g, White.b, 255);
-	SDL_RenderClear(ren);
-	SDL_UpdateTexture(tex, NULL, framebuffer, 160*4*sizeof(RGBA));
-	SDL_RenderCopy(ren, tex, NULL, NULL);
+	{
+		GB::TimelineScope scope(GB::PHASE_FLIP);
+		SDL_SetRenderDrawColor(ren, White.r, White.g, White.b, 255);
+		SDL_RenderClear(ren);
+		SDL_UpdateTexture(tex, NULL, framebuffer, 160*4*sizeof(RGBA));
+		SDL_RenderCopy(ren, tex, NULL, NULL);
+	}
+	GB::TimelineScope scope(GB::PHASE_VSYNC);
 	SDL_RenderPresent(ren);
 }
 
@@ -45,6 +74,19 @@ void IO::set_px(int x, int y, const RGB &c) {
 	framebuffer[y*160*4+x].a = 255;
 }
 
+//A 160x144 picture, scaled up 4 times
+void IO::draw(const RGB *screen) {
+	for(int y=0;y<144;++y) {
+		for(int x=0;x<160;++x) {
+			for(int iy = 0; iy < 4; iy++) {
+				for(int ix = 0; ix < 4; ix++) {
+					set_px(x*4+ix,y*4+iy,screen[y*160+x]);
+				}
+			}
+		}
+	}
+}
+
 void IO::clear(const RGB& c) {
 	if(!ren) return;
 	memset(framebuffer, 0, 160*4*144*4*sizeof(RGBA));
@@ -1,10 +1,8 @@
 #pragma once
 
 #include <SDL.h>
-
-struct RGB {
-	uint8_t r, g, b;
-};
+#include "gameboy/audio_ring.h"
+#include "util.h"
 
 struct RGBA {
 	uint8_t r;
@@ -13,15 +11,17 @@ struct RGBA {
 	uint8_t a;
 };
 
-constexpr RGB Black = {0,0,0};
-constexpr RGB White = {255,255,255};
-
 struct IO {
 	SDL_Window *win;
 	SDL_Renderer *ren;
 	SDL_Texture *tex;
 	RGBA framebuffer[160*4*144*4];
+	SDL_AudioDeviceID audio_dev;
+
+	static void audio_callback(void *userdata, Uint8 *stream, int len);
 public:
+	GB::AudioRing audio;
+
 	IO();
 	~IO();
 
@@ -29,6 +29,7 @@ public:
 	void destroy();
 	void flip();
 	void set_px(int x, int y, const RGB &color);
+	void draw(const RGB *screen);
 	void clear(const RGB &color = Black);
 	void set_title(const char* title);
 };
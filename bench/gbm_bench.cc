@@ -0,0 +1,343 @@
+//Headless whole-system benchmark. Runs a rom, or one of the synthetic
+//workloads, for a fixed number of frames and reports JSON on stdout:
+//emulated MHz, frames/s, host ns per guest instruction and how the time
+//splits over cpu, mmu (slow path), ppu (line rendering) and presentation
+//(scaling the picture up like the SDL frontend does).
+//
+//The headline numbers are the median of --repeat plain runs. The split
+//comes from one extra run with a Profile attached, which itself costs a
+//little time on every slow path access and rendered line.
+//
+//With --perf one more run reads the host hardware counters around every
+//frame and every rendered line, reported per frame. The cpu share is what
+//the frame counted minus the lines.
+//
+//--no-fusion leaves every loop to the interpreter, instructions count the
+//same either way. --recompiled runs the blocks of a tools/gbm_recompile
+//plugin built for the rom.
+//
+//With --baseline the result is compared against an earlier --out file and
+//the exit status is 1 when fps dropped by more than --threshold percent.
+#include "../gameboy/system.h"
+#include "../gameboy/movie.h"
+#include "../gameboy/profile.h"
+#include "../gameboy/perf_counters.h"
+#include "synthetic.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+	struct Options {
+		const char *rom;
+		const char *synthetic;
+		const char *movie;
+		const char *out;
+		const char *baseline;
+		long frames;
+		long warmup;
+		int repeat;
+		double threshold;
+		bool perf;
+		bool fusion;
+		const char *recompiled;
+	};
+
+	struct Run {
+		uint64_t frames;
+		uint64_t cycles;
+		uint64_t instructions;
+		double seconds;  //Emulation and presentation
+		double present;
+		double mmu;
+		double ppu;
+		bool halted;
+		bool counted;            //Host counters could be opened
+		GB::PerfSample frame;    //Per frame
+		GB::PerfSample line;     //Per frame, line rendering only
+		GB::PerfSample worst;    //Per frame, the most in the last second
+	};
+
+	struct Result {
+		std::string name;
+		Run run;
+		double mhz;
+		double fps;
+		double ns_per_instruction;
+		double split[4]; //cpu, mmu, ppu, present as fractions
+		Run perf;        //The --perf run
+	};
+
+	RGB upscaled[160*4*144*4];
+
+	//What IO::draw does without handing it to SDL
+	void present(const RGB *screen) {
+		for(int y=0;y<144*4;++y) {
+			const RGB *line = screen + (y/4)*160;
+			RGB *out = upscaled + y*160*4;
+			for(int x=0;x<160*4;++x) {
+				out[x] = line[x/4];
+			}
+		}
+	}
+
+	//Read the whole rom up front, every run loads it from memory
+	bool read_file(const char *filename, std::vector<uint8_t> &data) {
+		FILE *fp = fopen(filename, "rb");
+		if(!fp) return false;
+		uint8_t buf[4096];
+		size_t n;
+		while((n = fread(buf, 1, sizeof(buf), fp)) > 0) data.insert(data.end(), buf, buf + n);
+		fclose(fp);
+		return !data.empty();
+	}
+
+	Run run(const Options &options, const std::vector<uint8_t> &rom, const GB::Movie *movie, GB::Recompiled *recompiled, bool profiled, bool counted) {
+		Run result = Run();
+		GB::System *system = new GB::System();
+		system->load(rom.data(), rom.size());
+		GB::MoviePlayer *player = movie ? new GB::MoviePlayer(*movie) : nullptr;
+		system->input.source = player;
+		system->proc.fusion = options.fusion;
+		system->set_recompiled(recompiled);
+
+		for(long i=0;i<options.warmup;++i) {
+			if(system->run_frame() == 0) break;
+		}
+
+		GB::Profile profile;
+		if(profiled) system->set_profile(&profile);
+		GB::PerfCounters perf;
+		GB::PerfStats stats(60);
+		if(counted && perf.open()) system->set_perf(&perf);
+		GB::PerfSample before, after;
+
+		const uint64_t instructions = system->instructions + system->proc.fused;
+		uint64_t present_ticks = 0;
+		const uint64_t start_ticks = GB::ticks();
+		auto start = std::chrono::steady_clock::now();
+		for(long i=0;i<options.frames;++i) {
+			if(system->gpu.perf) perf.read(before);
+			const int cycles = system->run_frame();
+			if(system->gpu.perf) {
+				perf.read(after);
+				stats.add(after.since(before));
+			}
+			if(cycles == 0) {
+				result.halted = true;
+				break;
+			}
+			result.cycles += cycles;
+			++result.frames;
+
+			const uint64_t t = GB::ticks();
+			present(system->gpu.framebuffer);
+			present_ticks += GB::ticks() - t;
+		}
+		result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		const double per_tick = result.seconds / double(GB::ticks() - start_ticks);
+		result.instructions = system->instructions + system->proc.fused - instructions;
+		result.present = present_ticks * per_tick;
+		result.mmu = profile.mmu * per_tick;
+		result.ppu = profile.ppu * per_tick;
+		result.counted = perf.available();
+		for(int i=0;i<GB::PERF_COUNTERS && stats.frames;++i) {
+			result.frame.counts[i] = stats.total.counts[i] / stats.frames;
+			result.line.counts[i] = perf.ppu.counts[i] / stats.frames;
+		}
+		result.worst = stats.worst();
+
+		delete system;
+		delete player;
+		return result;
+	}
+
+	void write_json(FILE *fp, const Result &result, const Options &options) {
+		const Run &r = result.run;
+		fprintf(fp, "{\n");
+		fprintf(fp, "\t\"workload\": \"%s\",\n", result.name.c_str());
+		fprintf(fp, "\t\"frames\": %llu,\n", (unsigned long long)r.frames);
+		fprintf(fp, "\t\"cycles\": %llu,\n", (unsigned long long)r.cycles);
+		fprintf(fp, "\t\"instructions\": %llu,\n", (unsigned long long)r.instructions);
+		fprintf(fp, "\t\"repeat\": %d,\n", options.repeat);
+		fprintf(fp, "\t\"halted\": %s,\n", r.halted ? "true" : "false");
+		fprintf(fp, "\t\"seconds\": %.6f,\n", r.seconds);
+		fprintf(fp, "\t\"mhz\": %.3f,\n", result.mhz);
+		fprintf(fp, "\t\"fps\": %.2f,\n", result.fps);
+		fprintf(fp, "\t\"ns_per_instruction\": %.3f,\n", result.ns_per_instruction);
+		fprintf(fp, "\t\"split\": {\"cpu\": %.4f, \"mmu\": %.4f, \"ppu\": %.4f, \"present\": %.4f}%s\n",
+			result.split[0], result.split[1], result.split[2], result.split[3], options.perf ? "," : "");
+		if(options.perf) {
+			fprintf(fp, "\t\"perf\": {\n\t\t\"available\": %s,\n", result.perf.counted ? "true" : "false");
+			fprintf(fp, "\t\t\"frame\": ");
+			result.perf.frame.write_json(fp);
+			fprintf(fp, ",\n\t\t\"cpu\": ");
+			result.perf.frame.since(result.perf.line).write_json(fp);
+			fprintf(fp, ",\n\t\t\"ppu\": ");
+			result.perf.line.write_json(fp);
+			fprintf(fp, ",\n\t\t\"worst\": ");
+			result.perf.worst.write_json(fp);
+			fprintf(fp, "\n\t}\n");
+		}
+		fprintf(fp, "}\n");
+	}
+
+	//Good enough for the files write_json makes
+	bool json_number(const std::string &json, const char *key, double &value) {
+		const std::string quoted = std::string("\"") + key + "\":";
+		const size_t at = json.find(quoted);
+		if(at == std::string::npos) return false;
+		value = strtod(json.c_str() + at + quoted.size(), nullptr);
+		return true;
+	}
+
+	int compare(const Result &result, const Options &options) {
+		FILE *fp = fopen(options.baseline, "rb");
+		if(!fp) {
+			fprintf(stderr, "could not open baseline %s\n", options.baseline);
+			return 2;
+		}
+		std::string json;
+		char buf[4096];
+		size_t n;
+		while((n = fread(buf, 1, sizeof(buf), fp)) > 0) json.append(buf, n);
+		fclose(fp);
+
+		struct { const char *key; double now; bool higher_is_better; } metrics[] = {
+			{"mhz", result.mhz, true},
+			{"fps", result.fps, true},
+			{"ns_per_instruction", result.ns_per_instruction, false},
+		};
+		int status = 0;
+		fprintf(stderr, "%-20s %12s %12s %8s\n", "metric", "baseline", "now", "change");
+		for(auto &metric : metrics) {
+			double before = 0;
+			if(!json_number(json, metric.key, before) || before == 0) continue;
+			const double change = (metric.now - before) / before * 100.0;
+			fprintf(stderr, "%-20s %12.3f %12.3f %+7.2f%%\n", metric.key, before, metric.now, change);
+			if(strcmp(metric.key, "fps") == 0 && change < -options.threshold) status = 1;
+		}
+		if(status) fprintf(stderr, "fps regressed by more than %.1f%%\n", options.threshold);
+		return status;
+	}
+
+	void usage(const char *self) {
+		fprintf(stderr, "usage: %s (rom | --synthetic name) [--frames n] [--warmup n] [--repeat n] [--movie file] [--out file] [--baseline file] [--threshold pct] [--perf] [--no-fusion] [--recompiled plugin]\n", self);
+		fprintf(stderr, "synthetic workloads:\n");
+		for(const Synthetic::Workload &workload : Synthetic::workloads()) {
+			fprintf(stderr, "\t%-6s %s\n", workload.name, workload.about);
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
+	Options options = {nullptr, nullptr, nullptr, nullptr, nullptr, 3600, 60, 5, 5.0, false, true, nullptr};
+	for(int i=1;i<argc;++i) {
+		     if(strcmp(argv[i], "--synthetic")==0 && i+1 < argc) options.synthetic = argv[++i];
+		else if(strcmp(argv[i], "--frames")==0 && i+1 < argc) options.frames = atol(argv[++i]);
+		else if(strcmp(argv[i], "--warmup")==0 && i+1 < argc) options.warmup = atol(argv[++i]);
+		else if(strcmp(argv[i], "--repeat")==0 && i+1 < argc) options.repeat = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--movie")==0 && i+1 < argc) options.movie = argv[++i];
+		else if(strcmp(argv[i], "--out")==0 && i+1 < argc) options.out = argv[++i];
+		else if(strcmp(argv[i], "--baseline")==0 && i+1 < argc) options.baseline = argv[++i];
+		else if(strcmp(argv[i], "--threshold")==0 && i+1 < argc) options.threshold = atof(argv[++i]);
+		else if(strcmp(argv[i], "--perf")==0) options.perf = true;
+		else if(strcmp(argv[i], "--no-fusion")==0) options.fusion = false;
+		else if(strcmp(argv[i], "--recompiled")==0 && i+1 < argc) options.recompiled = argv[++i];
+		else if(argv[i][0] != '-' && !options.rom) options.rom = argv[i];
+		else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if(!options.rom == !options.synthetic || options.frames <= 0) {
+		usage(argv[0]);
+		return 2;
+	}
+	if(options.repeat < 1) options.repeat = 1;
+
+	Result result;
+	std::vector<uint8_t> rom;
+	if(options.synthetic) {
+		const std::vector<Synthetic::Workload> list = Synthetic::workloads();
+		const Synthetic::Workload *workload = Synthetic::find(list, options.synthetic);
+		if(!workload) {
+			usage(argv[0]);
+			return 2;
+		}
+		rom = Synthetic::rom(workload->code);
+		result.name = std::string("synthetic:") + workload->name;
+	} else {
+		if(!read_file(options.rom, rom)) {
+			fprintf(stderr, "could not read rom %s\n", options.rom);
+			return 2;
+		}
+		result.name = options.rom;
+	}
+	GB::System *check = new GB::System();
+	const bool loaded = check->load(rom.data(), rom.size());
+	const uint64_t rom_hash = check->rom_hash;
+	delete check;
+	if(!loaded) {
+		fprintf(stderr, "could not load rom %s\n", result.name.c_str());
+		return 2;
+	}
+
+	GB::Movie movie;
+	if(options.movie) {
+		if(!movie.load(options.movie)) {
+			fprintf(stderr, "could not load movie %s\n", options.movie);
+			return 2;
+		}
+		if(movie.rom_hash != rom_hash) {
+			fprintf(stderr, "movie %s was recorded with a different rom\n", options.movie);
+			return 2;
+		}
+	}
+	const GB::Movie *source = options.movie ? &movie : nullptr;
+
+	GB::Recompiled recompiled;
+	if(options.recompiled) {
+		std::string error;
+		if(!recompiled.load(options.recompiled, rom_hash, error)) {
+			fprintf(stderr, "could not load %s: %s\n", options.recompiled, error.c_str());
+			return 2;
+		}
+	}
+	GB::Recompiled *blocks = options.recompiled ? &recompiled : nullptr;
+
+	std::vector<Run> runs;
+	for(int i=0;i<options.repeat;++i) {
+		runs.push_back(run(options, rom, source, blocks, false, false));
+	}
+	std::sort(runs.begin(), runs.end(), [](const Run &a, const Run &b) { return a.seconds < b.seconds; });
+	result.run = runs[runs.size()/2];
+
+	const Run &r = result.run;
+	result.mhz = r.cycles / r.seconds / 1000000.0;
+	result.fps = r.frames / r.seconds;
+	result.ns_per_instruction = r.instructions ? (r.seconds - r.present) * 1e9 / r.instructions : 0;
+
+	const Run p = run(options, rom, source, blocks, true, false);
+	result.split[1] = p.mmu / p.seconds;
+	result.split[2] = p.ppu / p.seconds;
+	result.split[3] = p.present / p.seconds;
+	result.split[0] = 1.0 - result.split[1] - result.split[2] - result.split[3];
+	if(options.perf) result.perf = run(options, rom, source, blocks, false, true);
+
+	write_json(stdout, result, options);
+	if(options.out) {
+		FILE *fp = fopen(options.out, "wb");
+		if(!fp) {
+			fprintf(stderr, "could not write %s\n", options.out);
+			return 2;
+		}
+		write_json(fp, result, options);
+		fclose(fp);
+	}
+	return options.baseline ? compare(result, options) : 0;
+}
@@ -0,0 +1,259 @@
+//Component micro-benchmarks, no roms and no framework needed. Every case
+//calls one hot function in a loop on a system set up just for it:
+//Processor::decode on an endless in-memory instruction stream, MMU
+//read8/write8 on one address region, GPU::render_line with one LCDC and
+//scroll setting and, when built with the frontend, IO::draw and set_px.
+//
+//A case is calibrated until one sample takes about --ms milliseconds, then
+//timed for --samples samples. Reported is ns per call: the median, the
+//spread (standard deviation relative to the mean) and the fastest sample.
+#include "../gameboy/system.h"
+#include "synthetic.h"
+#ifdef GBM_BENCH_IO
+#include "../IO.h"
+#endif
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+	struct Case {
+		std::string name;
+		std::function<uint64_t(long)> body; //Runs n calls, returns something to keep
+	};
+
+	struct Stats {
+		double median;
+		double spread; //Percent
+		double min;
+	};
+
+	volatile uint64_t sink;
+
+	double time_ns(const Case &c, long n) {
+		auto start = std::chrono::steady_clock::now();
+		sink += c.body(n);
+		return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	Stats measure(const Case &c, int samples, double ms) {
+		long n = 1;
+		while(time_ns(c, n) < ms * 1e6 && n < (1L << 40)) n *= 2;
+
+		std::vector<double> per_op;
+		for(int i=0;i<samples;++i) {
+			per_op.push_back(time_ns(c, n) / n);
+		}
+		double mean = 0;
+		for(double x : per_op) mean += x;
+		mean /= per_op.size();
+		double var = 0;
+		for(double x : per_op) var += (x - mean) * (x - mean);
+		var /= per_op.size();
+
+		std::sort(per_op.begin(), per_op.end());
+		Stats stats;
+		stats.median = per_op[per_op.size()/2];
+		stats.spread = mean > 0 ? std::sqrt(var) / mean * 100.0 : 0;
+		stats.min = per_op[0];
+		return stats;
+	}
+
+	//Systems live as long as the cases using them
+	std::vector<std::shared_ptr<GB::System>> systems;
+
+	//An MBC1 cart with 8KB of external ram, code at 0x150 and a RET at 0x1000
+	GB::System& make_system(const std::vector<uint8_t> &code = {}) {
+		std::vector<uint8_t> rom = Synthetic::rom(code);
+		rom[0x0147] = 0x03;
+		rom[0x0149] = 0x02;
+		rom[0x1000] = 0xC9;
+		systems.push_back(std::shared_ptr<GB::System>(new GB::System()));
+		GB::System &system = *systems.back();
+		system.load(rom.data(), rom.size());
+		return system;
+	}
+
+	//pattern repeated for about 1KB, then JP 0x150
+	std::vector<uint8_t> stream(const std::vector<uint8_t> &pattern) {
+		std::vector<uint8_t> code;
+		while(code.size() < 1024) code.insert(code.end(), pattern.begin(), pattern.end());
+		code.push_back(0xC3);
+		code.push_back(0x50);
+		code.push_back(0x01);
+		return code;
+	}
+
+	void add_decode(std::vector<Case> &cases, const char *name, const std::vector<uint8_t> &pattern) {
+		GB::System &system = make_system(stream(pattern));
+		system.proc.regs.PC = 0x150;
+		system.proc.regs.HL = 0xC000;
+		system.proc.regs.SP = 0xDFF0;
+		cases.push_back(Case{std::string("decode ") + name, [&system](long n) {
+			uint64_t cycles = 0;
+			for(long i=0;i<n;++i) cycles += system.proc.decode();
+			return cycles;
+		}});
+	}
+
+	void add_read(std::vector<Case> &cases, const char *name, uint16_t base, uint16_t mask) {
+		GB::System &system = make_system();
+		system.mmu.write8(0x0000, 0x0A); //Enable external ram
+		cases.push_back(Case{std::string("read8 ") + name, [&system, base, mask](long n) {
+			uint64_t sum = 0;
+			for(long i=0;i<n;++i) sum += system.mmu.read8(base + (i & mask));
+			return sum;
+		}});
+	}
+
+	void add_write(std::vector<Case> &cases, const char *name, uint16_t base, uint16_t mask, uint8_t value_mask = 0xFF, uint8_t value_or = 0) {
+		GB::System &system = make_system();
+		system.mmu.write8(0x0000, 0x0A);
+		cases.push_back(Case{std::string("write8 ") + name, [&system, base, mask, value_mask, value_or](long n) {
+			for(long i=0;i<n;++i) system.mmu.write8(base + (i & mask), (i & value_mask) | value_or);
+			return uint64_t(system.mmu.read8(base));
+		}});
+	}
+
+	void add_render(std::vector<Case> &cases, const char *name, uint8_t lcdc, uint8_t scx, uint8_t scy, bool cgb = false) {
+		GB::System &system = make_system();
+		GB::GPU &gpu = system.gpu;
+		uint32_t seed = 12345;
+		for(size_t i=0;i<sizeof(gpu.vram);++i) {
+			seed = seed * 1103515245 + 12345;
+			gpu.vram[i] = seed >> 16;
+		}
+		gpu.lcdc = lcdc;
+		gpu.x_scrl = scx;
+		gpu.y_scrl = scy;
+		system.mmu.cgb = cgb;
+		cases.push_back(Case{std::string("render_line ") + name, [&system](long n) {
+			GB::GPU &gpu = system.gpu;
+			for(long i=0;i<n;++i) {
+				gpu.current_line = i % 144;
+				gpu.render_line();
+			}
+			return uint64_t(gpu.framebuffer[160*72].r);
+		}});
+	}
+
+#ifdef GBM_BENCH_IO
+	//set_px only checks that a renderer exists, the frame never reaches SDL
+	std::shared_ptr<IO> make_io() {
+		IO *io = new IO();
+		io->ren = reinterpret_cast<SDL_Renderer*>(io);
+		return std::shared_ptr<IO>(io, [](IO *io) {
+			io->ren = nullptr;
+			delete io;
+		});
+	}
+
+	void add_io(std::vector<Case> &cases) {
+		std::shared_ptr<IO> io = make_io();
+		GB::System &system = make_system();
+		cases.push_back(Case{"io draw", [io, &system](long n) {
+			for(long i=0;i<n;++i) io->draw(system.gpu.framebuffer);
+			return uint64_t(io->framebuffer[0].r);
+		}});
+		cases.push_back(Case{"io set_px", [io](long n) {
+			const RGB color = {1, 2, 3};
+			for(long i=0;i<n;++i) io->set_px(i % (160*4), (i / (160*4)) % (144*4), color);
+			return uint64_t(io->framebuffer[0].r);
+		}});
+	}
+#endif
+
+	std::vector<Case> all_cases() {
+		std::vector<Case> cases;
+		add_decode(cases, "alu", {
+			0x3C, 0x80, 0x91, 0xA0, //INC A, ADD A,B, SUB A,C, AND B
+			0xB1, 0xA9, 0xB8, 0x1D, //OR C, XOR C, CP B, DEC E
+			0x87, 0x2F, 0x04, 0x0D, //ADD A,A, CPL, INC B, DEC C
+		});
+		add_decode(cases, "loads", {
+			0x4F, 0x78, 0x7E, 0x77, //LD C,A, LD A,B, LD A,(HL), LD (HL),A
+			0x22, 0x2B, 0x3E, 0x12, //LDI (HL),A, DEC HL, LD A,0x12
+			0x46, 0x70, 0x57,       //LD B,(HL), LD (HL),B, LD D,A
+		});
+		add_decode(cases, "branches", {
+			0x18, 0x00,       //JR +0
+			0xAF,             //XOR A
+			0x20, 0x00,       //JR NZ,+0 (not taken)
+			0x28, 0x00,       //JR Z,+0 (taken)
+			0xCD, 0x00, 0x10, //CALL 0x1000 (RET)
+		});
+		add_decode(cases, "cb", {
+			0xCB, 0x37, 0xCB, 0x47, //SWAP A, BIT 0,A
+			0xCB, 0x12, 0xCB, 0x3F, //RL D, SRL A
+			0xCB, 0xD8, 0xCB, 0x87, //SET 3,B, RES 0,A
+			0xCB, 0x27, 0xCB, 0x1D, //SLA A, RR L
+		});
+
+		add_read(cases, "rom0", 0x0000, 0xFF);
+		add_read(cases, "romx", 0x4000, 0xFF);
+		add_read(cases, "vram", 0x8000, 0xFF);
+		add_read(cases, "eram", 0xA000, 0xFF);
+		add_read(cases, "wram0", 0xC000, 0xFF);
+		add_read(cases, "wramx", 0xD000, 0xFF);
+		add_read(cases, "echo", 0xE000, 0xFF);
+		add_read(cases, "oam", 0xFE00, 0x7F);
+		add_read(cases, "io P1", 0xFF00, 0);
+		add_read(cases, "io DIV", 0xFF04, 0);
+		add_read(cases, "io LY", 0xFF44, 0);
+		add_read(cases, "hram", 0xFF80, 0x3F);
+		add_read(cases, "IE", 0xFFFF, 0);
+
+		add_write(cases, "mbc bank", 0x2000, 0xFF, 0x01, 0x01);
+		add_write(cases, "vram", 0x8000, 0xFF);
+		add_write(cases, "eram", 0xA000, 0xFF);
+		add_write(cases, "wram0", 0xC000, 0xFF);
+		add_write(cases, "wramx", 0xD000, 0xFF);
+		add_write(cases, "oam", 0xFE00, 0x7F);
+		add_write(cases, "io SCX", 0xFF43, 0);
+		add_write(cases, "hram", 0xFF80, 0x3F);
+
+		add_render(cases, "bg 8000/9800", 0x91, 0, 0);
+		add_render(cases, "bg 8800/9C00", 0x89, 0, 0);
+		add_render(cases, "bg scrolled", 0x91, 3, 77);
+		add_render(cases, "bg off", 0x80, 0, 0);
+		add_render(cases, "lcd off", 0x00, 0, 0);
+		add_render(cases, "cgb", 0x91, 3, 77, true);
+
+#ifdef GBM_BENCH_IO
+		add_io(cases);
+#endif
+		return cases;
+	}
+}
+
+int main(int argc, char *argv[]) {
+	const char *filter = nullptr;
+	int samples = 15;
+	double ms = 20;
+	for(int i=1;i<argc;++i) {
+		     if(strcmp(argv[i], "--samples")==0 && i+1 < argc) samples = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--ms")==0 && i+1 < argc) ms = atof(argv[++i]);
+		else if(argv[i][0] != '-' && !filter) filter = argv[i];
+		else {
+			fprintf(stderr, "usage: %s [filter] [--samples n] [--ms n]\n", argv[0]);
+			return 2;
+		}
+	}
+	if(samples < 1) samples = 1;
+
+	printf("%-26s %10s %8s %10s\n", "case", "ns/op", "spread", "min");
+	for(const Case &c : all_cases()) {
+		if(filter && c.name.find(filter) == std::string::npos) continue;
+		const Stats stats = measure(c, samples, ms);
+		printf("%-26s %10.2f %7.1f%% %10.2f\n", c.name.c_str(), stats.median, stats.spread, stats.min);
+		fflush(stdout);
+	}
+	return 0;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+//Tiny generated roms, so benchmarks need no commercial games. Each one is a
+//32KB rom only cart that jumps from 0x100 to an endless loop at 0x150.
+namespace Synthetic {
+
+	struct Workload {
+		const char *name;
+		const char *about;
+		std::vector<uint8_t> code;
+	};
+
+	inline std::vector<Workload> workloads() {
+		std::vector<Workload> list;
+		list.push_back(Workload{"cpu", "register alu and branches, lcd left on from reset", {
+			0x3C,       //INC A
+			0x80,       //ADD A,B
+			0x4F,       //LD C,A
+			0xA9,       //XOR C
+			0x1D,       //DEC E
+			0x20, 0xF9, //JR NZ,0x150
+			0x14,       //INC D
+			0x18, 0xF6, //JR 0x150
+		}});
+		list.push_back(Workload{"ppu", "lcd on, tile data and scroll rewritten every line", {
+			0x3E, 0x91,       //LD A,0x91
+			0xE0, 0x40,       //LDH (LCDC),A
+			0x21, 0x00, 0x80, //LD HL,0x8000
+			0xF0, 0x44,       //LDH A,(LY)
+			0xE0, 0x43,       //LDH (SCX),A
+			0x22,             //LD (HL+),A
+			0x7C,             //LD A,H
+			0xFE, 0x98,       //CP 0x98
+			0x20, 0xF6,       //JR NZ,0x157
+			0x18, 0xF1,       //JR 0x154
+		}});
+		list.push_back(Workload{"mmio", "timer, interrupt flag, zero and working ram", {
+			0xF0, 0x04,       //LDH A,(DIV)
+			0xE0, 0x80,       //LDH (0x80),A
+			0xF0, 0x0F,       //LDH A,(IF)
+			0xEA, 0x00, 0xC0, //LD (0xC000),A
+			0xE0, 0x06,       //LDH (TMA),A
+			0x18, 0xF3,       //JR 0x150
+		}});
+		list.push_back(Workload{"loops", "copy, clear and delay loops over working and video ram, lcd on", {
+			0x3E, 0x91,       //LD A,0x91
+			0xE0, 0x40,       //LDH (LCDC),A
+			0x21, 0x00, 0x00, //LD HL,0x0000
+			0x11, 0x00, 0xC0, //LD DE,0xC000
+			0x01, 0x00, 0x04, //LD BC,0x400
+			0x2A,             //LD A,(HL+)
+			0x12,             //LD (DE),A
+			0x13,             //INC DE
+			0x0B,             //DEC BC
+			0x78,             //LD A,B
+			0xB1,             //OR C
+			0x20, 0xF8,       //JR NZ,0x15D
+			0x21, 0x00, 0xC0, //LD HL,0xC000
+			0x11, 0x00, 0x88, //LD DE,0x8800
+			0x01, 0x00, 0x04, //LD BC,0x400
+			0x2A,             //LD A,(HL+)
+			0x12,             //LD (DE),A
+			0x13,             //INC DE
+			0x0B,             //DEC BC
+			0x78,             //LD A,B
+			0xB1,             //OR C
+			0x20, 0xF8,       //JR NZ,0x16E
+			0x21, 0x00, 0xC4, //LD HL,0xC400
+			0x01, 0x00, 0x02, //LD BC,0x200
+			0xAF,             //XOR A
+			0x22,             //LD (HL+),A
+			0x0B,             //DEC BC
+			0x78,             //LD A,B
+			0xB1,             //OR C
+			0x20, 0xF9,       //JR NZ,0x17C
+			0x05,             //DEC B
+			0x20, 0xFD,       //JR NZ,0x183
+			0x18, 0xCC,       //JR 0x154
+		}});
+		return list;
+	}
+
+	inline std::vector<uint8_t> rom(const std::vector<uint8_t> &code) {
+		std::vector<uint8_t> rom(0x8000, 0x00);
+		const uint8_t entry[] = {0xC3, 0x50, 0x01}; //JP 0x150
+		memcpy(&rom[0x100], entry, sizeof(entry));
+		memcpy(&rom[0x150], code.data(), code.size());
+		return rom;
+	}
+
+	inline const Workload* find(const std::vector<Workload> &list, const char *name) {
+		for(const Workload &workload : list) {
+			if(strcmp(workload.name, name) == 0) return &workload;
+		}
+		return nullptr;
+	}
+}
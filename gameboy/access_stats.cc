@@ -0,0 +1,169 @@
+#include "access_stats.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace {
+	struct Name {
+		uint16_t addr;
+		const char *name;
+	};
+
+	const Name io_names[] = {
+		{0xFF00, "P1"}, {0xFF01, "SB"}, {0xFF02, "SC"},
+		{0xFF04, "DIV"}, {0xFF05, "TIMA"}, {0xFF06, "TMA"}, {0xFF07, "TAC"}, {0xFF0F, "IF"},
+		{0xFF10, "NR10"}, {0xFF11, "NR11"}, {0xFF12, "NR12"}, {0xFF13, "NR13"}, {0xFF14, "NR14"},
+		{0xFF16, "NR21"}, {0xFF17, "NR22"}, {0xFF18, "NR23"}, {0xFF19, "NR24"},
+		{0xFF1A, "NR30"}, {0xFF1B, "NR31"}, {0xFF1C, "NR32"}, {0xFF1D, "NR33"}, {0xFF1E, "NR34"},
+		{0xFF20, "NR41"}, {0xFF21, "NR42"}, {0xFF22, "NR43"}, {0xFF23, "NR44"},
+		{0xFF24, "NR50"}, {0xFF25, "NR51"}, {0xFF26, "NR52"},
+		{0xFF40, "LCDC"}, {0xFF41, "STAT"}, {0xFF42, "SCY"}, {0xFF43, "SCX"}, {0xFF44, "LY"}, {0xFF45, "LYC"},
+		{0xFF46, "DMA"}, {0xFF47, "BGP"}, {0xFF48, "OBP0"}, {0xFF49, "OBP1"}, {0xFF4A, "WY"}, {0xFF4B, "WX"},
+		{0xFF4D, "KEY1"}, {0xFF4F, "VBK"}, {0xFF50, "BOOT"},
+		{0xFF51, "HDMA1"}, {0xFF52, "HDMA2"}, {0xFF53, "HDMA3"}, {0xFF54, "HDMA4"}, {0xFF55, "HDMA5"},
+		{0xFF56, "RP"}, {0xFF68, "BCPS"}, {0xFF69, "BCPD"}, {0xFF6A, "OCPS"}, {0xFF6B, "OCPD"}, {0xFF6C, "OPRI"},
+		{0xFF70, "SVBK"}, {0xFF76, "PCM12"}, {0xFF77, "PCM34"},
+	};
+
+	struct Region {
+		const char *name;
+		int first, last; //Pages, inclusive
+	};
+
+	//0xFF is split into MMIO and zero ram by the register counters
+	const Region regions[] = {
+		{"rom0", 0x00, 0x3F}, {"romx", 0x40, 0x7F}, {"vram", 0x80, 0x9F}, {"eram", 0xA0, 0xBF},
+		{"wram0", 0xC0, 0xCF}, {"wramx", 0xD0, 0xDF}, {"echo", 0xE0, 0xFD}, {"oam", 0xFE, 0xFE},
+	};
+
+	const char* region_name(int page) {
+		for(const Region &region : regions) {
+			if(page >= region.first && page <= region.last) return region.name;
+		}
+		return "io+hram";
+	}
+
+	uint64_t unmapped(const GB::AccessStats::Counter &c) {
+		return c.unmapped_reads + c.unmapped_writes;
+	}
+
+	//Log scale, so a page touched once still shows next to the hottest one
+	char shade(uint64_t count, uint64_t max) {
+		static const char levels[] = ".:-=+*#%@";
+		if(!count) return ' ';
+		if(max <= 1) return levels[sizeof(levels) - 2];
+		const int level = int(std::log(double(count)) / std::log(double(max)) * (sizeof(levels) - 2));
+		return levels[std::min(level, int(sizeof(levels) - 2))];
+	}
+
+	void grid(FILE *fp, const char *title, const GB::AccessStats::Counter *pages, uint64_t GB::AccessStats::Counter::*field) {
+		uint64_t max = 0;
+		for(int i=0;i<256;++i) {
+			max = std::max(max, pages[i].*field);
+		}
+		fprintf(fp, "%s by page, one column per 256 bytes ('.' to '@' log scale up to %llu)\n", title, (unsigned long long)max);
+		fprintf(fp, "        0123456789ABCDEF\n");
+		for(int row=0;row<16;++row) {
+			char cells[17];
+			for(int col=0;col<16;++col) {
+				cells[col] = shade(pages[row*16 + col].*field, max);
+			}
+			cells[16] = '\0';
+			fprintf(fp, "0x%X000  %s\n", row, cells);
+		}
+	}
+}
+
+GB::AccessStats::AccessStats() {
+	reset();
+}
+
+void GB::AccessStats::reset() {
+	memset(pages, 0, sizeof(pages));
+	memset(io, 0, sizeof(io));
+}
+
+const char* GB::AccessStats::io_name(uint16_t addr) {
+	for(const Name &name : io_names) {
+		if(name.addr == addr) return name.name;
+	}
+	if(addr >= 0xFF30 && addr < 0xFF40) return "WAVE";
+	return "-";
+}
+
+//Heatmaps of reads and writes, totals per region and every MMIO register
+//that was touched, busiest first
+void GB::AccessStats::write_text(FILE *fp) const {
+	Counter total = {0, 0, 0, 0};
+	for(const Counter &c : pages) {
+		total.reads += c.reads;
+		total.writes += c.writes;
+		total.unmapped_reads += c.unmapped_reads;
+		total.unmapped_writes += c.unmapped_writes;
+	}
+	fprintf(fp, "accesses: %llu reads, %llu writes, %llu unmapped\n",
+		(unsigned long long)total.reads, (unsigned long long)total.writes, (unsigned long long)unmapped(total));
+	grid(fp, "reads", pages, &Counter::reads);
+	grid(fp, "writes", pages, &Counter::writes);
+
+	Counter mmio = {0, 0, 0, 0};
+	for(const Counter &c : io) {
+		mmio.reads += c.reads;
+		mmio.writes += c.writes;
+		mmio.unmapped_reads += c.unmapped_reads;
+		mmio.unmapped_writes += c.unmapped_writes;
+	}
+	const Counter &last = pages[0xFF];
+	const Counter hram = {last.reads - mmio.reads, last.writes - mmio.writes,
+		last.unmapped_reads - mmio.unmapped_reads, last.unmapped_writes - mmio.unmapped_writes};
+
+	fprintf(fp, "%-8s %14s %14s %10s\n", "region", "reads", "writes", "unmapped");
+	for(const Region &region : regions) {
+		Counter sum = {0, 0, 0, 0};
+		for(int i=region.first;i<=region.last;++i) {
+			sum.reads += pages[i].reads;
+			sum.writes += pages[i].writes;
+			sum.unmapped_reads += pages[i].unmapped_reads;
+			sum.unmapped_writes += pages[i].unmapped_writes;
+		}
+		fprintf(fp, "%-8s %14llu %14llu %10llu\n", region.name,
+			(unsigned long long)sum.reads, (unsigned long long)sum.writes, (unsigned long long)unmapped(sum));
+	}
+	fprintf(fp, "%-8s %14llu %14llu %10llu\n", "mmio",
+		(unsigned long long)mmio.reads, (unsigned long long)mmio.writes, (unsigned long long)unmapped(mmio));
+	fprintf(fp, "%-8s %14llu %14llu %10llu\n", "hram",
+		(unsigned long long)hram.reads, (unsigned long long)hram.writes, (unsigned long long)unmapped(hram));
+
+	std::vector<int> touched;
+	for(int i=0;i<128;++i) {
+		if(io[i].reads || io[i].writes) touched.push_back(i);
+	}
+	std::sort(touched.begin(), touched.end(), [this](int a, int b) {
+		return io[a].reads + io[a].writes > io[b].reads + io[b].writes;
+	});
+	fprintf(fp, "%-6s %-6s %14s %14s %10s\n", "mmio", "name", "reads", "writes", "unmapped");
+	for(int i : touched) {
+		fprintf(fp, "0x%04X %-6s %14llu %14llu %10llu\n", 0xFF00 + i, io_name(0xFF00 + i),
+			(unsigned long long)io[i].reads, (unsigned long long)io[i].writes, (unsigned long long)unmapped(io[i]));
+	}
+}
+
+//One row per page and per MMIO register that was touched
+void GB::AccessStats::write_csv(FILE *fp) const {
+	fprintf(fp, "kind,addr,name,reads,writes,unmapped_reads,unmapped_writes\n");
+	for(int i=0;i<256;++i) {
+		const Counter &c = pages[i];
+		if(!c.reads && !c.writes) continue;
+		fprintf(fp, "page,0x%04X,%s,%llu,%llu,%llu,%llu\n", i << 8, region_name(i),
+			(unsigned long long)c.reads, (unsigned long long)c.writes,
+			(unsigned long long)c.unmapped_reads, (unsigned long long)c.unmapped_writes);
+	}
+	for(int i=0;i<128;++i) {
+		const Counter &c = io[i];
+		if(!c.reads && !c.writes) continue;
+		fprintf(fp, "io,0x%04X,%s,%llu,%llu,%llu,%llu\n", 0xFF00 + i, io_name(0xFF00 + i),
+			(unsigned long long)c.reads, (unsigned long long)c.writes,
+			(unsigned long long)c.unmapped_reads, (unsigned long long)c.unmapped_writes);
+	}
+}
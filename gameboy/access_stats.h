@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+
+namespace GB {
+
+	//Guest memory accesses per 256 byte page and per MMIO register, counted
+	//while attached to a System. Attaching takes every page off the MMU fast
+	//path so nothing is missed, which makes emulation a lot slower.
+	//
+	//Unmapped counts accesses that end in the MMU failure state, reading 0 and
+	//dropping writes. On the MMIO page those point at unimplemented hardware.
+	struct AccessStats {
+		struct Counter {
+			uint64_t reads;
+			uint64_t writes;
+			uint64_t unmapped_reads;
+			uint64_t unmapped_writes;
+		};
+
+		Counter pages[256]; //By address >> 8
+		Counter io[128];    //0xFF00-0xFF7F
+	public:
+		AccessStats();
+
+		void reset();
+
+		inline void read(uint16_t addr) {
+			++pages[addr >> 8].reads;
+			if((addr & 0xFF80) == 0xFF00) ++io[addr & 0x7F].reads;
+		}
+
+		inline void write(uint16_t addr) {
+			++pages[addr >> 8].writes;
+			if((addr & 0xFF80) == 0xFF00) ++io[addr & 0x7F].writes;
+		}
+
+		inline void unmapped_read(uint16_t addr) {
+			++pages[addr >> 8].unmapped_reads;
+			if((addr & 0xFF80) == 0xFF00) ++io[addr & 0x7F].unmapped_reads;
+		}
+
+		inline void unmapped_write(uint16_t addr) {
+			++pages[addr >> 8].unmapped_writes;
+			if((addr & 0xFF80) == 0xFF00) ++io[addr & 0x7F].unmapped_writes;
+		}
+
+		void write_text(FILE *fp) const;
+		void write_csv(FILE *fp) const;
+
+		static const char* io_name(uint16_t addr);
+	};
+}
@@ -0,0 +1,476 @@
+#include "apu.h"
+#include "scheduler.h"
+#include "audio_ring.h"
+#include "wav.h"
+#include "state.h"
+#include <cstring>
+
+namespace {
+	//Bit n set means duty step n is high
+	const uint8_t duty_table[4] = {0x80, 0x81, 0xE1, 0x7E};
+
+	const unsigned noise_divisor[8] = {8, 16, 32, 48, 64, 80, 96, 112};
+
+	const int wave_shifts[4] = {4, 0, 1, 2};
+
+	//Bits that always read back as 1
+	const uint8_t read_mask[0x30] = {
+		0x80, 0x3F, 0x00, 0xFF, 0xBF, //NR10-NR14
+		0xFF, 0x3F, 0x00, 0xFF, 0xBF, //unused, NR21-NR24
+		0x7F, 0xFF, 0x9F, 0xFF, 0xBF, //NR30-NR34
+		0xFF, 0xFF, 0x00, 0x00, 0xBF, //unused, NR41-NR44
+		0x00, 0x00, 0x70,             //NR50-NR52
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, //unused
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, //Wave ram
+		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	};
+}
+
+GB::APU::APU(Scheduler &sched) : sched(sched), ring(nullptr), wav(nullptr) {
+	blip[0].set_rates(clock_rate, sample_rate);
+	blip[1].set_rates(clock_rate, sample_rate);
+	reset();
+}
+
+void GB::APU::reset() {
+	memset(regs, 0, sizeof(regs));
+	memset(ch, 0, sizeof(ch));
+	memset(wave, 0, sizeof(wave));
+	queued = 0;
+	nr43 = 0;
+	nr50 = 0;
+	nr51 = 0;
+	noise_narrow = false;
+	duty[0] = duty[1] = 0;
+	wave_shift = 4;
+	sweep_period = sweep_timer = sweep_shift = 0;
+	sweep_neg = sweep_on = false;
+	sweep_shadow = 0;
+	for(int c=0;c<4;++c) {
+		update_period(c);
+	}
+
+	//Powered on, as left by the boot rom
+	power = true;
+	regs[0x16] = 0x80;
+
+	seq_step = 0;
+	time = sched.real();
+	frame_start = sched.real();
+	seq_next = sched.real() + sequencer_period;
+	blip[0].clear();
+	blip[1].clear();
+}
+
+//Pending writes are applied first, so only synthesized state is saved
+void GB::APU::save(StateWriter &w) {
+	sync();
+	w.put(regs, sizeof(regs));
+	w.put(ch, sizeof(ch));
+	w.put(wave, sizeof(wave));
+	w.put(nr43);
+	w.put(nr50);
+	w.put(nr51);
+	w.put(power);
+	w.put(noise_narrow);
+	w.put(duty, sizeof(duty));
+	w.put(wave_shift);
+	w.put(sweep_period);
+	w.put(sweep_timer);
+	w.put(sweep_shift);
+	w.put(sweep_neg);
+	w.put(sweep_on);
+	w.put(sweep_shadow);
+	w.put(seq_step);
+	w.put(seq_next);
+	w.put(time);
+}
+
+void GB::APU::load(StateReader &r) {
+	r.get(regs, sizeof(regs));
+	r.get(ch, sizeof(ch));
+	r.get(wave, sizeof(wave));
+	r.get(nr43);
+	r.get(nr50);
+	r.get(nr51);
+	r.get(power);
+	r.get(noise_narrow);
+	r.get(duty, sizeof(duty));
+	r.get(wave_shift);
+	r.get(sweep_period);
+	r.get(sweep_timer);
+	r.get(sweep_shift);
+	r.get(sweep_neg);
+	r.get(sweep_on);
+	r.get(sweep_shadow);
+	r.get(seq_step);
+	r.get(seq_next);
+	r.get(time);
+	queued = 0;
+
+	//Restart the sample buffers from silence at the restored levels
+	frame_start = time;
+	blip[0].clear();
+	blip[1].clear();
+	for(int c=0;c<4;++c) {
+		ch[c].amp[0] = ch[c].amp[1] = 0;
+	}
+	emit_all(time);
+}
+
+int GB::APU::level(int c) const {
+	const Channel &k = ch[c];
+	if(!k.on || !k.dac) return 0;
+	switch(c) {
+		case 0:
+		case 1:
+			return (duty_table[duty[c]] >> k.pos) & 1 ? k.volume : 0;
+		case 2:
+			{
+				const uint8_t b = wave[k.pos >> 1];
+				return ((k.pos & 1) ? (b & 0x0F) : (b >> 4)) >> wave_shift;
+			}
+		case 3:
+			return (k.lfsr & 1) ? 0 : k.volume;
+	}
+	return 0;
+}
+
+//Turn a change in channel output into deltas for the left and right buffers
+void GB::APU::emit(int c, uint64_t at) {
+	Channel &k = ch[c];
+	const int l = level(c);
+	const int vol[2] = {((nr50 >> 4) & 7) + 1, (nr50 & 7) + 1};
+	const uint8_t enable[2] = {(uint8_t)(0x10 << c), (uint8_t)(0x01 << c)};
+	for(int side=0;side<2;++side) {
+		const int amp = (nr51 & enable[side]) ? l * vol[side] * gain : 0;
+		if(amp != k.amp[side]) {
+			blip[side].add_delta(at - frame_start, amp - k.amp[side]);
+			k.amp[side] = amp;
+		}
+	}
+}
+
+void GB::APU::emit_all(uint64_t at) {
+	for(int c=0;c<4;++c) {
+		emit(c, at);
+	}
+}
+
+void GB::APU::update_period(int c) {
+	Channel &k = ch[c];
+	switch(c) {
+		case 0:
+		case 1:
+			k.period = (2048 - k.freq) * 4;
+			break;
+		case 2:
+			k.period = (2048 - k.freq) * 2;
+			break;
+		case 3:
+			k.period = noise_divisor[nr43 & 0x07] << (nr43 >> 4);
+			break;
+	}
+}
+
+int GB::APU::sweep_calc(uint64_t at) {
+	int f = sweep_shadow >> sweep_shift;
+	f = sweep_neg ? sweep_shadow - f : sweep_shadow + f;
+	if(f > 2047) {
+		ch[0].on = false;
+		emit(0, at);
+	}
+	return f;
+}
+
+void GB::APU::trigger(int c, uint64_t at) {
+	Channel &k = ch[c];
+	k.on = k.dac;
+	if(k.length == 0) k.length = c == 2 ? 256 : 64;
+	update_period(c);
+	k.next = at + k.period;
+	k.volume = k.initial;
+	k.env_timer = k.env_period;
+	if(c == 2) k.pos = 0;
+	if(c == 3) k.lfsr = 0x7FFF;
+	if(c == 0) {
+		sweep_shadow = k.freq;
+		sweep_timer = sweep_period ? sweep_period : 8;
+		sweep_on = sweep_period || sweep_shift;
+		if(sweep_shift) sweep_calc(at);
+	}
+	emit(c, at);
+}
+
+void GB::APU::clock_sequencer(uint64_t at) {
+	const int step = seq_step;
+	seq_step = (seq_step + 1) & 7;
+	if(!power) return;
+
+	if((step & 1) == 0) { //Length, 256Hz
+		for(int c=0;c<4;++c) {
+			Channel &k = ch[c];
+			if(k.length_on && k.length && --k.length == 0) {
+				k.on = false;
+				emit(c, at);
+			}
+		}
+	}
+
+	if(step == 2 || step == 6) { //Sweep, 128Hz
+		if(--sweep_timer <= 0) {
+			sweep_timer = sweep_period ? sweep_period : 8;
+			if(sweep_on && sweep_period) {
+				const int f = sweep_calc(at);
+				if(f <= 2047 && sweep_shift) {
+					sweep_shadow = f;
+					ch[0].freq = f;
+					update_period(0);
+					sweep_calc(at);
+				}
+			}
+		}
+	}
+
+	if(step == 7) { //Envelope, 64Hz
+		static const int with_envelope[3] = {0, 1, 3};
+		for(int i=0;i<3;++i) {
+			Channel &k = ch[with_envelope[i]];
+			if(k.env_period == 0 || --k.env_timer > 0) continue;
+			k.env_timer = k.env_period;
+			if(k.env_up && k.volume < 15) ++k.volume;
+			else if(!k.env_up && k.volume > 0) --k.volume;
+			emit(with_envelope[i], at);
+		}
+	}
+}
+
+void GB::APU::run_channel(int c, uint64_t end) {
+	Channel &k = ch[c];
+	if(!k.on || k.next > end) return;
+
+	//Nobody is listening, only keep the timer phase
+	if(!ring && !wav) {
+		k.next += ((end - k.next) / k.period + 1) * k.period;
+		return;
+	}
+
+	while(k.next <= end) {
+		switch(c) {
+			case 0:
+			case 1:
+				k.pos = (k.pos + 1) & 7;
+				break;
+			case 2:
+				k.pos = (k.pos + 1) & 31;
+				break;
+			case 3:
+				{
+					const unsigned bit = (k.lfsr ^ (k.lfsr >> 1)) & 1;
+					k.lfsr = (k.lfsr >> 1) | (bit << 14);
+					if(noise_narrow) k.lfsr = (k.lfsr & ~0x40) | (bit << 6);
+				}
+				break;
+		}
+		emit(c, k.next);
+		k.next += k.period;
+	}
+}
+
+void GB::APU::render(uint64_t until) {
+	while(time < until) {
+		const uint64_t end = until < seq_next ? until : seq_next;
+		for(int c=0;c<4;++c) {
+			run_channel(c, end);
+		}
+		time = end;
+		if(time == seq_next) {
+			clock_sequencer(time);
+			seq_next += sequencer_period;
+		}
+	}
+}
+
+//Render up to a cycle, draining the sample buffers if the span would overflow them
+void GB::APU::advance(uint64_t until) {
+	while(until - frame_start > blip[0].max_clocks()) {
+		render(frame_start + blip[0].max_clocks());
+		flush_samples();
+	}
+	render(until);
+}
+
+void GB::APU::apply(uint16_t addr, uint8_t value, uint64_t at) {
+	if(addr >= 0xFF30) {
+		wave[addr - 0xFF30] = value;
+		return;
+	}
+	if(!power && addr != 0xFF26) return;
+
+	switch(addr) {
+		case 0xFF10: //NR10
+			sweep_period = (value >> 4) & 0x07;
+			sweep_neg = value & 0x08;
+			sweep_shift = value & 0x07;
+			break;
+		case 0xFF11: //NR11
+		case 0xFF16: //NR21
+			{
+				const int c = addr == 0xFF11 ? 0 : 1;
+				duty[c] = value >> 6;
+				ch[c].length = 64 - (value & 0x3F);
+				emit(c, at);
+			}
+			break;
+		case 0xFF12: //NR12
+		case 0xFF17: //NR22
+		case 0xFF21: //NR42
+			{
+				const int c = addr == 0xFF12 ? 0 : addr == 0xFF17 ? 1 : 3;
+				Channel &k = ch[c];
+				k.initial = value >> 4;
+				k.env_up = value & 0x08;
+				k.env_period = value & 0x07;
+				k.dac = value & 0xF8;
+				if(!k.dac) k.on = false;
+				emit(c, at);
+			}
+			break;
+		case 0xFF13: //NR13
+		case 0xFF18: //NR23
+		case 0xFF1D: //NR33
+			{
+				const int c = addr == 0xFF13 ? 0 : addr == 0xFF18 ? 1 : 2;
+				ch[c].freq = (ch[c].freq & 0x700) | value;
+				update_period(c);
+			}
+			break;
+		case 0xFF14: //NR14
+		case 0xFF19: //NR24
+		case 0xFF1E: //NR34
+		case 0xFF23: //NR44
+			{
+				const int c = addr == 0xFF14 ? 0 : addr == 0xFF19 ? 1 : addr == 0xFF1E ? 2 : 3;
+				Channel &k = ch[c];
+				if(c != 3) {
+					k.freq = (k.freq & 0xFF) | ((value & 0x07) << 8);
+					update_period(c);
+				}
+				k.length_on = value & 0x40;
+				if(value & 0x80) trigger(c, at);
+			}
+			break;
+		case 0xFF1A: //NR30
+			ch[2].dac = value & 0x80;
+			if(!ch[2].dac) ch[2].on = false;
+			emit(2, at);
+			break;
+		case 0xFF1B: //NR31
+			ch[2].length = 256 - value;
+			break;
+		case 0xFF1C: //NR32
+			wave_shift = wave_shifts[(value >> 5) & 0x03];
+			emit(2, at);
+			break;
+		case 0xFF20: //NR41
+			ch[3].length = 64 - (value & 0x3F);
+			break;
+		case 0xFF22: //NR43
+			nr43 = value;
+			noise_narrow = value & 0x08;
+			update_period(3);
+			break;
+		case 0xFF24: //NR50
+			nr50 = value;
+			emit_all(at);
+			break;
+		case 0xFF25: //NR51
+			nr51 = value;
+			emit_all(at);
+			break;
+		case 0xFF26: //NR52
+			if(power && !(value & 0x80)) {
+				//Powering off clears every register
+				for(int c=0;c<4;++c) {
+					Channel &k = ch[c];
+					k.on = k.dac = k.length_on = false;
+					k.length = 0;
+					k.initial = k.volume = k.env_period = 0;
+					k.freq = 0;
+				}
+				duty[0] = duty[1] = 0;
+				sweep_period = sweep_shift = 0;
+				sweep_neg = false;
+				nr43 = nr50 = nr51 = 0;
+				emit_all(at);
+			} else if(!power && (value & 0x80)) {
+				seq_step = 0;
+			}
+			power = value & 0x80;
+			break;
+	}
+}
+
+void GB::APU::flush_samples() {
+	const uint32_t clocks = time - frame_start;
+	blip[0].end_frame(clocks);
+	blip[1].end_frame(clocks);
+	frame_start = time;
+
+	int16_t out[512 * 2];
+	int n;
+	while((n = blip[0].samples_avail()) > 0) {
+		if(n > 512) n = 512;
+		blip[0].read_samples(out, n, 2);
+		blip[1].read_samples(out + 1, n, 2);
+		if(ring) ring->write(out, n);
+		if(wav) wav->write(out, n);
+	}
+}
+
+//Apply queued register writes in order, synthesizing the audio in between
+void GB::APU::sync() {
+	for(unsigned i=0;i<queued;++i) {
+		advance(queue[i].when);
+		apply(queue[i].addr, queue[i].value, queue[i].when);
+	}
+	queued = 0;
+	advance(sched.real());
+}
+
+void GB::APU::end_frame() {
+	sync();
+	flush_samples();
+}
+
+uint8_t GB::APU::read8(uint16_t addr) {
+	if(addr < 0xFF10 || addr > 0xFF3F) return 0; //failure state
+	if(addr == 0xFF26) { //NR52, channel status needs the synthesized state
+		sync();
+		uint8_t status = power ? 0xF0 : 0x70;
+		for(int c=0;c<4;++c) {
+			if(ch[c].on) status |= 1 << c;
+		}
+		return status;
+	}
+	return regs[addr - 0xFF10] | read_mask[addr - 0xFF10];
+}
+
+void GB::APU::write8(uint16_t addr, uint8_t value) {
+	if(addr < 0xFF10 || addr > 0xFF3F) return; //failure state
+	const bool powered = regs[0x16] & 0x80;
+	if(addr == 0xFF26) {
+		if(!(value & 0x80)) memset(regs, 0, 0x16);
+		regs[0x16] = value & 0x80;
+	} else if(addr >= 0xFF30 || powered) {
+		regs[addr - 0xFF10] = value;
+	} else {
+		return; //Registers are read-only while powered off
+	}
+
+	if(queued == queue_size) sync();
+	queue[queued].when = sched.real();
+	queue[queued].addr = addr;
+	queue[queued].value = value;
+	++queued;
+}
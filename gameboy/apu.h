@@ -0,0 +1,96 @@
+#pragma once
+#include "blip.h"
+#include <cstdint>
+
+namespace GB {
+
+	struct Scheduler;
+	struct AudioRing;
+	struct WavWriter;
+	struct StateWriter;
+	struct StateReader;
+
+	//Register writes are queued with their cycle stamp and only applied when
+	//audio is synthesized, which happens in blocks at the end of a frame or
+	//when a read needs up to date channel status.
+	struct APU {
+		enum {
+			clock_rate = 4194304,
+			sample_rate = 44100,
+			sequencer_period = 8192, //512Hz
+			queue_size = 512,
+			gain = 32
+		};
+
+		struct Write {
+			uint64_t when;
+			uint16_t addr;
+			uint8_t value;
+		};
+
+		struct Channel {
+			bool on;
+			bool dac;
+			unsigned length;
+			bool length_on;
+			int initial;
+			int volume;
+			int env_period;
+			int env_timer;
+			bool env_up;
+			int freq;       //11 bit frequency (square, wave)
+			unsigned period; //Cycles per waveform step
+			unsigned pos;   //Duty step or wave sample
+			uint16_t lfsr;  //Noise shift register
+			uint64_t next;  //Cycle of next waveform step
+			int amp[2];     //Current contribution, left and right
+		};
+
+		Scheduler &sched;
+		uint8_t regs[0x30]; //0xFF10-0xFF3F as seen by the cpu
+		Write queue[queue_size];
+		unsigned queued;
+
+		Channel ch[4];
+		uint8_t wave[16];
+		uint8_t nr43, nr50, nr51;
+		bool power;
+		bool noise_narrow;
+		int duty[2];
+		int wave_shift;
+		int sweep_period, sweep_timer, sweep_shift;
+		bool sweep_neg, sweep_on;
+		int sweep_shadow;
+		int seq_step;
+		uint64_t seq_next;
+		uint64_t time;        //Single speed cycle up to which audio has been synthesized
+		uint64_t frame_start; //Cycle of blip time 0
+		Blip blip[2];
+
+		int level(int c) const;
+		void emit(int c, uint64_t at);
+		void emit_all(uint64_t at);
+		void update_period(int c);
+		int sweep_calc(uint64_t at);
+		void trigger(int c, uint64_t at);
+		void clock_sequencer(uint64_t at);
+		void run_channel(int c, uint64_t end);
+		void render(uint64_t until);
+		void advance(uint64_t until);
+		void apply(uint16_t addr, uint8_t value, uint64_t at);
+		void flush_samples();
+	public:
+		AudioRing *ring; //Optional sinks, synthesis is skipped without any
+		WavWriter *wav;
+
+		APU(Scheduler &sched);
+
+		void reset();
+		void save(StateWriter &w);
+		void load(StateReader &r);
+		void sync();
+		void end_frame();
+		uint8_t read8(uint16_t addr);
+		void write8(uint16_t addr, uint8_t value);
+	};
+}
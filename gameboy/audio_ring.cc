@@ -0,0 +1,49 @@
+#include "audio_ring.h"
+#include <cstring>
+
+GB::AudioRing::AudioRing() {
+	clear();
+}
+
+void GB::AudioRing::clear() {
+	head.store(0, std::memory_order_relaxed);
+	tail.store(0, std::memory_order_relaxed);
+}
+
+size_t GB::AudioRing::available() const {
+	return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+}
+
+size_t GB::AudioRing::space() const {
+	return capacity - available();
+}
+
+size_t GB::AudioRing::write(const int16_t *frames, size_t count) {
+	const uint32_t h = head.load(std::memory_order_relaxed);
+	const uint32_t t = tail.load(std::memory_order_acquire);
+	const size_t room = capacity - (h - t);
+	if(count > room) count = room;
+
+	const size_t start = h & (capacity - 1);
+	const size_t first = count < capacity - start ? count : capacity - start;
+	memcpy(data + start*2, frames, first * 2 * sizeof(int16_t));
+	memcpy(data, frames + first*2, (count - first) * 2 * sizeof(int16_t));
+
+	head.store(h + count, std::memory_order_release);
+	return count;
+}
+
+size_t GB::AudioRing::read(int16_t *frames, size_t count) {
+	const uint32_t t = tail.load(std::memory_order_relaxed);
+	const uint32_t h = head.load(std::memory_order_acquire);
+	const size_t avail = h - t;
+	if(count > avail) count = avail;
+
+	const size_t start = t & (capacity - 1);
+	const size_t first = count < capacity - start ? count : capacity - start;
+	memcpy(frames, data + start*2, first * 2 * sizeof(int16_t));
+	memcpy(frames + first*2, data, (count - first) * 2 * sizeof(int16_t));
+
+	tail.store(t + count, std::memory_order_release);
+	return count;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace GB {
+
+	//Single producer/single consumer ring of interleaved stereo frames.
+	//The emulator thread writes, the audio callback reads, neither locks.
+	struct AudioRing {
+		enum { capacity = 8192 }; //Frames, power of two
+
+		int16_t data[capacity * 2];
+		std::atomic<uint32_t> head; //Frames written, owned by the producer
+		std::atomic<uint32_t> tail; //Frames read, owned by the consumer
+	public:
+		AudioRing();
+
+		void clear();
+		size_t available() const;
+		size_t space() const;
+		size_t write(const int16_t *frames, size_t count);
+		size_t read(int16_t *frames, size_t count);
+	};
+}
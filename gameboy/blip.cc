@@ -0,0 +1,103 @@
+#include "blip.h"
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+int16_t GB::Blip::kernel[GB::Blip::phases][GB::Blip::taps];
+
+//Once for every instance, Runner builds systems on several threads at a time
+void GB::Blip::init_kernel() {
+	static std::once_flag once;
+	std::call_once(once, &Blip::build_kernel);
+}
+
+void GB::Blip::build_kernel() {
+	const double pi = 3.14159265358979323846;
+	const double cutoff = 0.9; //Fraction of nyquist
+	for(int p=0;p<phases;++p) {
+		double k[taps];
+		double sum = 0;
+		for(int i=0;i<taps;++i) {
+			//Distance from the (delayed) step position to this tap
+			double x = i - (taps/2) + 1 - (double)p/phases;
+			double s = x == 0 ? 1.0 : sin(pi*x*cutoff)/(pi*x*cutoff);
+			double w = 0.42 + 0.5*cos(pi*x/(taps/2)) + 0.08*cos(2*pi*x/(taps/2)); //Blackman
+			if(fabs(x) >= taps/2) w = 0;
+			k[i] = s * w;
+			sum += k[i];
+		}
+		//Every phase must integrate to exactly one step
+		int total = 0;
+		int peak = 0;
+		for(int i=0;i<taps;++i) {
+			kernel[p][i] = (int16_t)floor(k[i] * (1 << delta_bits) / sum + 0.5);
+			total += kernel[p][i];
+			if(kernel[p][i] > kernel[p][peak]) peak = i;
+		}
+		kernel[p][peak] += (1 << delta_bits) - total;
+	}
+}
+
+GB::Blip::Blip() {
+	init_kernel();
+	factor = 0;
+	clear();
+}
+
+void GB::Blip::clear() {
+	memset(buf, 0, sizeof(buf));
+	offset = 0;
+	integrator = 0;
+}
+
+void GB::Blip::set_rates(double clock_rate, double sample_rate) {
+	factor = (uint64_t)(sample_rate / clock_rate * ((uint64_t)1 << frac_bits));
+}
+
+//Longest span of clocks that fits in the buffer before samples must be read
+uint32_t GB::Blip::max_clocks() const {
+	const uint64_t room = ((uint64_t)(capacity - samples_avail() - 1) << frac_bits) - (offset & 0xFFFFFFFF);
+	return (uint32_t)(room / factor);
+}
+
+void GB::Blip::add_delta(uint32_t time, int delta) {
+	if(delta == 0) return;
+	const uint64_t fixed = time * factor + offset;
+	const int32_t phase = (fixed >> (frac_bits - phase_bits)) & (phases - 1);
+	const int16_t *k = kernel[phase];
+	int32_t *out = buf + (fixed >> frac_bits);
+	for(int i=0;i<taps;++i) {
+		out[i] += k[i] * delta;
+	}
+}
+
+void GB::Blip::end_frame(uint32_t clocks) {
+	offset += clocks * factor;
+}
+
+int GB::Blip::samples_avail() const {
+	return (int)(offset >> frac_bits);
+}
+
+int GB::Blip::read_samples(int16_t *out, int count, int stride) {
+	const int avail = samples_avail();
+	if(count > avail) count = avail;
+	if(count <= 0) return 0;
+
+	int32_t sum = integrator;
+	for(int i=0;i<count;++i) {
+		sum += buf[i];
+		int32_t s = sum >> delta_bits;
+		sum -= s * (1 << (delta_bits - bass_shift)); //High-pass, removes DC, s may be negative
+		if(s > 32767) s = 32767;
+		if(s < -32768) s = -32768;
+		out[i*stride] = (int16_t)s;
+	}
+	integrator = sum;
+
+	const int remain = avail - count + taps;
+	memmove(buf, buf + count, remain * sizeof(int32_t));
+	memset(buf + remain, 0, (capacity + taps - remain) * sizeof(int32_t));
+	offset -= (uint64_t)count << frac_bits;
+	return count;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+
+namespace GB {
+
+	//Band-limited step synthesis. Amplitude changes are added as deltas at a
+	//clock time and spread over a windowed sinc kernel, samples are produced
+	//by integrating the delta buffer when they are read.
+	struct Blip {
+		enum {
+			phase_bits = 5,
+			phases = 1 << phase_bits,
+			taps = 16,
+			delta_bits = 15,
+			bass_shift = 9,
+			frac_bits = 32,
+			capacity = 4096 //Samples that can be pending between reads
+		};
+
+		int32_t buf[capacity + taps];
+		uint64_t factor; //Samples per clock, fixed point
+		uint64_t offset; //Position of the frame start, fixed point
+		int32_t integrator;
+
+		static int16_t kernel[phases][taps];
+		static void init_kernel();
+		static void build_kernel();
+	public:
+		Blip();
+
+		void clear();
+		void set_rates(double clock_rate, double sample_rate);
+		uint32_t max_clocks() const;
+		void add_delta(uint32_t time, int delta);
+		void end_frame(uint32_t clocks);
+		int samples_avail() const;
+		int read_samples(int16_t *out, int count, int stride);
+	};
+}
@@ -4,13 +4,19 @@
 #include <cstddef>
 #include <cassert>
 #include <cstdio>
+#include <cstring>
+#include <memory>
+#include "state.h"
 
 namespace GB {
 
 	//TODO extract MBC's into their own struct
 	struct Cart {
 		uint8_t *rom; //Raw cartridge rom
+		size_t rom_size;
+		std::shared_ptr<uint8_t> rom_owner; //Clones share one copy of the rom
 		uint8_t *eram; //External cartridge ram
+		uint8_t *eram_dirty; //Written 256 byte blocks of eram
 		struct {
 			int mbc;
 			bool ram;
@@ -135,6 +141,10 @@ namespace GB {
 			}
 		}
 
+		bool is_cgb() {
+			return rom && (rom[0x0143] & 0x80); //CGB flag, 0x80 or 0xC0
+		}
+
 		uint8_t eram_banks() {
 			assert(rom);
 			switch(rom[0x0149]) {
@@ -151,7 +161,8 @@ namespace GB {
 			if(addr < 0x4000)
 				return rom[addr]; //Rom, bank 0
 			else if(addr < 0x8000) {
-				return rom[addr-0x4000+rom_offset];
+				const size_t offset = addr-0x4000+rom_offset;
+				return offset < rom_size ? rom[offset] : 0xFF; //Bank past the end of the rom
 			}
 			return 0; //failure state
 		}
@@ -220,15 +231,69 @@ namespace GB {
 					eram[addr-0xA000+ram_offset] = value;
 					break;
 			}
+			eram_dirty[(addr-0xA000+ram_offset) >> DIRTY_SHIFT] = 1;
+		}
+
+		size_t eram_blocks() {
+			return (eram_size() >> DIRTY_SHIFT) + 1;
 		}
 	public:
-		Cart() : rom(nullptr), eram(nullptr) {
+		Cart() : rom(nullptr), rom_size(0), eram(nullptr), eram_dirty(nullptr) {
+			unload();
+		}
+
+		~Cart() {
 			unload();
 		}
 
 		void unload() {
-			if(rom) delete [] rom;
+			rom_owner.reset();
 			if(eram) delete [] eram;
+			if(eram_dirty) delete [] eram_dirty;
+			rom = nullptr;
+			rom_size = 0;
+			eram = nullptr;
+			eram_dirty = nullptr;
+		}
+
+		//Use the rom of other, with ram of our own
+		void share(const Cart &other) {
+			unload();
+			rom_owner = other.rom_owner;
+			rom = other.rom;
+			rom_size = other.rom_size;
+			mbc_type = other.mbc_type;
+			if(rom) alloc_eram();
+			reset();
+		}
+
+		void alloc_eram() {
+			eram = new uint8_t[eram_size()];
+			eram_dirty = new uint8_t[eram_blocks()];
+			memset(eram_dirty, 1, eram_blocks());
+		}
+
+		void save(StateWriter &w) {
+			w.put<uint64_t>(rom_offset);
+			w.put<int32_t>(rom_bank);
+			w.put<uint64_t>(ram_offset);
+			w.put<int32_t>(mbc_mode);
+			w.put(eram, rom ? eram_size() : 0, eram_dirty);
+		}
+
+		void load(StateReader &r) {
+			uint64_t rom_off = 0x4000, ram_off = 0;
+			int32_t bank = 1, mode = 0;
+			r.get(rom_off);
+			r.get(bank);
+			r.get(ram_off);
+			r.get(mode);
+			r.get(eram, rom ? eram_size() : 0);
+			if(rom) memset(eram_dirty, 1, eram_blocks());
+			rom_offset = rom_off;
+			rom_bank = bank;
+			ram_offset = ram_off;
+			mbc_mode = mode;
 		}
 
 		void reset() {
@@ -238,28 +303,49 @@ namespace GB {
 			mbc_mode = 0; //16Mbit ROM/8KByte RAM
 		}
 
-		void load(const char* filename) {
+		//Takes ownership of a new[] allocated rom. Roms under 32KB are padded
+		//with zeroes, bank 0 and 1 are always mapped.
+		void attach(uint8_t *data, size_t size) {
 			unload();
+			if(size < 0x8000) {
+				uint8_t *padded = new uint8_t[0x8000]();
+				memcpy(padded, data, size);
+				delete[] data;
+				data = padded;
+				size = 0x8000;
+			}
+			rom = data;
+			rom_owner.reset(rom, std::default_delete<uint8_t[]>());
+			rom_size = size;
+			mbc_type.parse(rom[0x0147]);
+			alloc_eram();
+			reset();
+		}
+
+		bool load(const uint8_t *data, size_t size) {
+			if(size < 0x150) return false; //No header
+			uint8_t *copy = new uint8_t[size];
+			memcpy(copy, data, size);
+			attach(copy, size);
+			return true;
+		}
+
+		void load(const char* filename) {
 			FILE *fp = fopen(filename, "rb");
 			//Determine file size
 			fseek(fp, 0, SEEK_END);
 			size_t size = ftell(fp);
 			fseek(fp, 0, SEEK_SET);
 
-			rom = new uint8_t[size];
-			fread(rom, 1, size, fp);
+			uint8_t *data = new uint8_t[size];
+			fread(data, 1, size, fp);
 			fclose(fp);
-
-			mbc_type.parse(rom[0x0147]);
-
-			eram = new uint8_t[eram_size()];
+			attach(data, size);
 
 			printf("rom %s loaded (%zu bytes)\n", filename, size);
-			printf("\t[title %.16s]\n", &rom[0x0134]);
+			printf("\t[title %.16s]%s\n", &rom[0x0134], is_cgb() ? " [cgb]" : "");
 			printf("\t[mbc %u] [ram %u] [batt %u] [timer %u] [rumble %u]\n",mbc_type.mbc, mbc_type.ram, mbc_type.batt, mbc_type.timer, mbc_type.rumble);
 			printf("\t[eram %u bank(s) (%zu bytes)]\n", eram_banks(), eram_size());
-
-			reset();
 		}
 
 		uint8_t read8(uint16_t addr) {
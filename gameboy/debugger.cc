@@ -0,0 +1,85 @@
+#include "debugger.h"
+#include "system.h"
+#include <cstring>
+
+GB::Debugger::Debugger(System &system) : system(system), pc(0), skip(false), suspended(false), stopped(false) {
+	memset(&hit, 0, sizeof(hit));
+	system.proc.debugger = this;
+	system.mmu.debugger = this;
+}
+
+GB::Debugger::~Debugger() {
+	watches.clear();
+	update_watch_pages();
+	system.proc.debugger = nullptr;
+	system.mmu.debugger = nullptr;
+	for(uint64_t *bits : breakpoints) {
+		delete[] bits;
+	}
+}
+
+void GB::Debugger::add_breakpoint(uint16_t bank, uint16_t addr) {
+	if(bank >= breakpoints.size()) breakpoints.resize(bank + 1, nullptr);
+	if(!breakpoints[bank]) {
+		breakpoints[bank] = new uint64_t[0x10000 / 64];
+		memset(breakpoints[bank], 0, 0x10000 / 8);
+	}
+	breakpoints[bank][addr >> 6] |= uint64_t(1) << (addr & 63);
+}
+
+void GB::Debugger::remove_breakpoint(uint16_t bank, uint16_t addr) {
+	if(bank >= breakpoints.size() || !breakpoints[bank]) return;
+	breakpoints[bank][addr >> 6] &= ~(uint64_t(1) << (addr & 63));
+}
+
+void GB::Debugger::add_watch(uint16_t addr, uint16_t size, int kinds) {
+	if(size == 0) size = 1;
+	watches.push_back(Watch{addr, size, kinds});
+	update_watch_pages();
+}
+
+void GB::Debugger::remove_watch(uint16_t addr) {
+	for(size_t i=0;i<watches.size();) {
+		if(watches[i].addr == addr) watches.erase(watches.begin() + i);
+		else ++i;
+	}
+	update_watch_pages();
+}
+
+void GB::Debugger::resume() {
+	stopped = false;
+	skip = hit.kind == DEBUG_BREAK;
+}
+
+bool GB::Debugger::hit_break(uint16_t bank, uint16_t addr) {
+	const Hit h = {DEBUG_BREAK, bank, addr, 0, addr};
+	if(callback && !callback(h)) return false;
+	hit = h;
+	stopped = true;
+	return true;
+}
+
+void GB::Debugger::access(int kind, uint16_t addr, uint8_t value) {
+	if(suspended) return;
+	for(const Watch &watch : watches) {
+		if(!(watch.kinds & kind) || uint16_t(addr - watch.addr) >= watch.size) continue;
+		const Hit h = {kind, system.mmu.bank(addr), addr, value, pc};
+		if(callback && !callback(h)) return;
+		hit = h;
+		stopped = true;
+		return;
+	}
+}
+
+//Pages with a watch leave the fast path for the kinds of access watched
+void GB::Debugger::update_watch_pages() {
+	uint8_t *pages = system.mmu.watch_page;
+	memset(pages, 0, sizeof(system.mmu.watch_page));
+	for(const Watch &watch : watches) {
+		const uint32_t end = uint32_t(watch.addr) + watch.size - 1;
+		for(uint32_t page = watch.addr >> 12; page <= (end >> 12) && page < 16; ++page) {
+			pages[page] |= watch.kinds;
+		}
+	}
+	system.mmu.map();
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "mmu.h"
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace GB {
+
+	struct System;
+
+	enum {
+		DEBUG_BREAK = 4 //Hit kind next to WATCH_READ and WATCH_WRITE
+	};
+
+	//Execution breakpoints and memory watchpoints for one system, attached for
+	//as long as the Debugger lives. A stop makes System::step return 0 like an
+	//invalid opcode does; resume() continues, past a breakpoint at pc.
+	//
+	//Breakpoints are a 64K bit map per bank, looked up before every
+	//instruction only while a debugger is attached. Watchpoints take the pages
+	//they cover off the MMU fast path, so only accesses to those pages pay
+	//for the check.
+	struct Debugger {
+		struct Hit {
+			int kind;       //DEBUG_BREAK, WATCH_READ or WATCH_WRITE
+			uint16_t bank;  //Of addr
+			uint16_t addr;
+			uint8_t value;  //Read or written
+			uint16_t pc;    //Instruction that did it
+		};
+
+		struct Watch {
+			uint16_t addr;
+			uint16_t size;
+			int kinds; //WATCH_READ | WATCH_WRITE
+		};
+
+		typedef std::function<bool(const Hit &hit)> Callback;
+
+		System &system;
+		std::vector<uint64_t*> breakpoints; //By bank, nullptr when a bank has none
+		std::vector<Watch> watches;
+		uint16_t pc;
+		bool skip;
+
+		bool hit_break(uint16_t bank, uint16_t addr);
+		void update_watch_pages();
+	public:
+		Callback callback; //Decides whether a hit stops, every hit stops without one
+		bool suspended;    //While RunAhead runs frames it rolls back, nothing hits
+		bool stopped;
+		Hit hit;           //The one that stopped
+
+		Debugger(System &system);
+		~Debugger();
+
+		void add_breakpoint(uint16_t bank, uint16_t addr);
+		void remove_breakpoint(uint16_t bank, uint16_t addr);
+		void add_watch(uint16_t addr, uint16_t size, int kinds);
+		void remove_watch(uint16_t addr);
+		void resume();
+
+		//Before the instruction at addr runs, true stops it
+		inline bool exec(uint16_t bank, uint16_t addr) {
+			pc = addr;
+			if(suspended) return false;
+			if(skip) {
+				skip = false;
+				return false;
+			}
+			const uint64_t *bits = bank < breakpoints.size() ? breakpoints[bank] : nullptr;
+			if(!bits || !((bits[addr >> 6] >> (addr & 63)) & 1)) return false;
+			return hit_break(bank, addr);
+		}
+
+		//A slow path access to a watched page
+		void access(int kind, uint16_t addr, uint8_t value);
+	};
+}
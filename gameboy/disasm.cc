@@ -0,0 +1,118 @@
+#include "disasm.h"
+#include <cstdio>
+
+//Decodes by the bit fields of the opcode, xx yyy zzz, instead of a table
+namespace {
+	const char *r[8] = {"B", "C", "D", "E", "H", "L", "(HL)", "A"};
+	const char *rp[4] = {"BC", "DE", "HL", "SP"};
+	const char *rp2[4] = {"BC", "DE", "HL", "AF"};
+	const char *cc[4] = {"NZ", "Z", "NC", "C"};
+	const char *alu[8] = {"ADD A,", "ADC A,", "SUB ", "SBC A,", "AND ", "XOR ", "OR ", "CP "};
+	const char *rot[8] = {"RLC", "RRC", "RL", "RR", "SLA", "SRA", "SWAP", "SRL"};
+	const char *x0z7[8] = {"RLCA", "RRCA", "RLA", "RRA", "DAA", "CPL", "SCF", "CCF"};
+}
+
+int GB::disassemble(const uint8_t *bytes, uint16_t pc, char *out, size_t size) {
+	const uint8_t op = bytes[0];
+	const uint8_t n = bytes[1];
+	const uint16_t nn = bytes[1] | (bytes[2] << 8);
+	const int8_t d = bytes[1];
+	const uint16_t jr = pc + 2 + d;
+	const int x = op >> 6, y = (op >> 3) & 7, z = op & 7, p = y >> 1, q = y & 1;
+
+	#define OUT(...) snprintf(out, size, __VA_ARGS__)
+	switch(x) {
+		case 0:
+			switch(z) {
+				case 0:
+					if(y == 0) { OUT("NOP"); return 1; }
+					if(y == 1) { OUT("LD (0x%04X),SP", nn); return 3; }
+					if(y == 2) { OUT("STOP"); return 2; }
+					if(y == 3) { OUT("JR 0x%04X", jr); return 2; }
+					OUT("JR %s,0x%04X", cc[y-4], jr);
+					return 2;
+				case 1:
+					if(q == 0) { OUT("LD %s,0x%04X", rp[p], nn); return 3; }
+					OUT("ADD HL,%s", rp[p]);
+					return 1;
+				case 2: {
+					const char *m[4] = {"(BC)", "(DE)", "(HL+)", "(HL-)"};
+					if(q == 0) OUT("LD %s,A", m[p]);
+					else OUT("LD A,%s", m[p]);
+					return 1;
+				}
+				case 3:
+					OUT("%s %s", q ? "DEC" : "INC", rp[p]);
+					return 1;
+				case 4:
+					OUT("INC %s", r[y]);
+					return 1;
+				case 5:
+					OUT("DEC %s", r[y]);
+					return 1;
+				case 6:
+					OUT("LD %s,0x%02X", r[y], n);
+					return 2;
+				default:
+					OUT("%s", x0z7[y]);
+					return 1;
+			}
+		case 1:
+			if(op == 0x76) OUT("HALT");
+			else OUT("LD %s,%s", r[y], r[z]);
+			return 1;
+		case 2:
+			OUT("%s%s", alu[y], r[z]);
+			return 1;
+	}
+
+	switch(z) {
+		case 0:
+			if(y < 4) { OUT("RET %s", cc[y]); return 1; }
+			if(y == 4) { OUT("LDH (0x%02X),A", n); return 2; }
+			if(y == 5) { OUT("ADD SP,%d", d); return 2; }
+			if(y == 6) { OUT("LDH A,(0x%02X)", n); return 2; }
+			OUT("LD HL,SP%+d", d);
+			return 2;
+		case 1: {
+			const char *m[4] = {"RET", "RETI", "JP HL", "LD SP,HL"};
+			if(q == 0) OUT("POP %s", rp2[p]);
+			else OUT("%s", m[p]);
+			return 1;
+		}
+		case 2:
+			if(y < 4) { OUT("JP %s,0x%04X", cc[y], nn); return 3; }
+			if(y == 4) { OUT("LD (C),A"); return 1; }
+			if(y == 5) { OUT("LD (0x%04X),A", nn); return 3; }
+			if(y == 6) { OUT("LD A,(C)"); return 1; }
+			OUT("LD A,(0x%04X)", nn);
+			return 3;
+		case 3:
+			if(y == 0) { OUT("JP 0x%04X", nn); return 3; }
+			if(y == 1) {
+				const int cx = n >> 6, cy = (n >> 3) & 7, cz = n & 7;
+				if(cx == 0) OUT("%s %s", rot[cy], r[cz]);
+				else OUT("%s %d,%s", cx == 1 ? "BIT" : cx == 2 ? "RES" : "SET", cy, r[cz]);
+				return 2;
+			}
+			if(y == 6) { OUT("DI"); return 1; }
+			if(y == 7) { OUT("EI"); return 1; }
+			break;
+		case 4:
+			if(y < 4) { OUT("CALL %s,0x%04X", cc[y], nn); return 3; }
+			break;
+		case 5:
+			if(q == 0) { OUT("PUSH %s", rp2[p]); return 1; }
+			if(p == 0) { OUT("CALL 0x%04X", nn); return 3; }
+			break;
+		case 6:
+			OUT("%s0x%02X", alu[y], n);
+			return 2;
+		case 7:
+			OUT("RST 0x%02X", y*8);
+			return 1;
+	}
+	OUT("DB 0x%02X", op);
+	return 1;
+	#undef OUT
+}
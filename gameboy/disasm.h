@@ -0,0 +1,10 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+namespace GB {
+
+	//Writes the instruction at bytes (located at pc) as text into out and
+	//returns its length in bytes. bytes must hold at least 3 bytes.
+	int disassemble(const uint8_t *bytes, uint16_t pc, char *out, size_t size);
+}
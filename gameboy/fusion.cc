@@ -0,0 +1,201 @@
+#include "processor.h"
+#include "scheduler.h"
+#include "gpu.h"
+#include "opcode_stats.h"
+#include <algorithm>
+#include <cstring>
+
+//Superinstructions for the loops guest code is full of: delays counting a
+//register down, fills and clears through HL and copies from HL to DE. A
+//taken JR NZ back to one of these bodies runs further iterations in bulk,
+//over memory on the fast path only (plain pages, so no MMIO, OAM DMA or
+//AccessStats). Fused iterations end before the next scheduler event and
+//before vblank. The GPU is stepped at the instruction that changes its mode,
+//with that iteration's store on the same side of render_line as in decode.
+//The last iteration, the one that falls through, is left to decode.
+
+namespace {
+	enum Kind {
+		DELAY8,  //DEC r; JR NZ
+		FILL8,   //LD (HL+/-),A; DEC r; JR NZ
+		DELAY16, //DEC rr; LD A,hi; OR lo; JR NZ
+		COPY8,   //LD A,(HL+); LD (DE),A; INC DE; DEC r; JR NZ
+		CLEAR16, //XOR A; LD (HL+),A; DEC BC; LD A,B; OR C; JR NZ
+		COPY16,  //LD A,(HL+); LD (DE),A; INC DE; DEC BC; LD A,B; OR C; JR NZ
+	};
+
+	//Cycles of every instruction of one iteration, the taken JR NZ last, and
+	//the instruction that stores, -1 for none
+	struct Body {
+		int cycles[7];
+		int count;
+		int store;
+	};
+
+	const Body bodies[] = {
+		{{4, 12}, 2, -1},
+		{{8, 4, 12}, 3, 0},
+		{{8, 4, 4, 12}, 4, -1},
+		{{8, 8, 8, 4, 12}, 5, 1},
+		{{4, 8, 8, 4, 4, 12}, 6, 1},
+		{{8, 8, 8, 8, 4, 4, 12}, 7, 1},
+	};
+
+	inline bool is_dec8(uint8_t op) {
+		return (op & 0xC7) == 0x05 && op != 0x35; //DEC r, not DEC (HL)
+	}
+
+	//Iterations, up to count, that access one byte each from addr on in
+	//direction step and stay on fast pages, and off code when it is set
+	uint64_t reach(uint8_t *const *pages, uint16_t addr, int step, uint64_t count, const uint8_t *code = nullptr, int length = 0) {
+		uint64_t done = 0;
+		while(done < count) {
+			const uint8_t *page = pages[addr >> 12];
+			if(!page) break;
+			const uint32_t offset = addr & 0x0FFF;
+			const uint32_t n = std::min<uint64_t>(count - done, step > 0 ? 0x1000 - offset : offset + 1);
+			const uint8_t *low = page + (step > 0 ? offset : offset + 1 - n);
+			if(code && low < code + length && code < low + n) break; //Would rewrite the loop itself
+			done += n;
+			addr = step > 0 ? addr + n : addr - n;
+		}
+		return done;
+	}
+
+	void mark(GB::MMU &mmu, uint16_t addr, uint32_t n) {
+		const uint32_t offset = addr & 0x0FFF;
+		memset(mmu.dirty_page[addr >> 12] + (offset >> 8), 1, ((offset + n - 1) >> 8) - (offset >> 8) + 1);
+	}
+
+	void fill(GB::MMU &mmu, uint16_t addr, int step, uint64_t count, uint8_t value) {
+		while(count) {
+			const uint32_t offset = addr & 0x0FFF;
+			const uint32_t n = std::min<uint64_t>(count, step > 0 ? 0x1000 - offset : offset + 1);
+			const uint16_t low = step > 0 ? addr : addr - (n - 1);
+			memset(mmu.write_page[low >> 12] + (low & 0x0FFF), value, n);
+			mark(mmu, low, n);
+			addr = step > 0 ? addr + n : addr - n;
+			count -= n;
+		}
+	}
+
+	void copy(GB::MMU &mmu, uint16_t dst, uint16_t src, uint64_t count) {
+		while(count) {
+			const uint32_t n = std::min<uint64_t>(count, 0x1000 - std::max(dst & 0x0FFF, src & 0x0FFF));
+			uint8_t *d = mmu.write_page[dst >> 12] + (dst & 0x0FFF);
+			const uint8_t *s = mmu.read_page[src >> 12] + (src & 0x0FFF);
+			if(d > s && d < s + n) { //Stores feed later loads, byte by byte like the guest
+				for(uint32_t i=0;i<n;++i) d[i] = s[i];
+			} else {
+				memmove(d, s, n);
+			}
+			mark(mmu, dst, n);
+			dst += n;
+			src += n;
+			count -= n;
+		}
+	}
+}
+
+//Called by a taken JR NZ back length bytes, with PC at the loop start. Returns
+//the cycles of the iterations run, 0 to leave the loop to decode.
+int GB::Processor::fuse(uint8_t length) {
+	if(trace || debugger || profiler || OpcodeStats::enabled || mmu.stall) return 0; //A stall adds to this JR NZ
+	const uint8_t *page = mmu.read_page[regs.PC >> 12];
+	if(!page || (regs.PC & 0x0FFF) + length > 0x1000) return 0;
+	const uint8_t *code = page + (regs.PC & 0x0FFF);
+
+	//The closing JR NZ is the one that called, only the body is matched
+	Kind kind;
+	uint8_t *counter8 = nullptr;
+	uint16_t *counter16 = &regs.BC;
+	uint8_t *regs8[8] = {&regs.B, &regs.C, &regs.D, &regs.E, &regs.H, &regs.L, nullptr, &regs.A};
+	if(length == 3 && is_dec8(code[0])) {
+		kind = DELAY8;
+		counter8 = regs8[code[0] >> 3];
+	} else if(length == 4 && (code[0] == 0x22 || code[0] == 0x32) && is_dec8(code[1]) && code[1] <= 0x1D) {
+		kind = FILL8;
+		counter8 = regs8[code[1] >> 3];
+	} else if(length == 5 && memcmp(code, "\x0B\x78\xB1", 3) == 0) {
+		kind = DELAY16;
+	} else if(length == 5 && memcmp(code, "\x1B\x7A\xB3", 3) == 0) {
+		kind = DELAY16;
+		counter16 = &regs.DE;
+	} else if(length == 6 && memcmp(code, "\x2A\x12\x13", 3) == 0 && (code[3] == 0x05 || code[3] == 0x0D)) {
+		kind = COPY8;
+		counter8 = regs8[code[3] >> 3];
+	} else if(length == 7 && memcmp(code, "\xAF\x22\x0B\x78\xB1", 5) == 0) {
+		kind = CLEAR16;
+	} else if(length == 8 && memcmp(code, "\x2A\x12\x13\x0B\x78\xB1", 6) == 0) {
+		kind = COPY16;
+	} else {
+		return 0;
+	}
+	const Body &body = bodies[kind];
+	int per = 0;
+	for(int i=0;i<body.count;++i) {
+		per += body.cycles[i];
+	}
+
+	//Taken iterations left, ending before the next event
+	Scheduler &sched = mmu.sched;
+	GPU &gpu = mmu.gpu;
+	const uint64_t now = sched.now + 12;
+	if(sched.next <= now || (uint64_t(std::max(gpu.cycles_left(), 0)) << sched.speed) <= 12) return 0;
+	uint64_t k = counter8 ? (*counter8 ? *counter8 : 256) - 1 : (*counter16 ? *counter16 : 65536) - 1;
+	k = std::min<uint64_t>(k, (sched.next - now - 1) / per);
+	const int step = code[0] == 0x32 ? -1 : 1;
+	if(kind == FILL8 || kind == CLEAR16) {
+		k = reach(mmu.write_page, regs.HL, step, k, code, length);
+	} else if(kind == COPY8 || kind == COPY16) {
+		k = std::min(reach(mmu.read_page, regs.HL, 1, k), reach(mmu.write_page, regs.DE, 1, k, code, length));
+	}
+	if(k == 0) return 0;
+
+	auto store = [&](uint64_t first, uint64_t n) {
+		if(kind == FILL8) fill(mmu, regs.HL + step * int(first), step, n, regs.A);
+		else if(kind == CLEAR16) fill(mmu, regs.HL + first, 1, n, 0);
+		else if(kind == COPY8 || kind == COPY16) copy(mmu, regs.DE + first, regs.HL + first, n);
+	};
+
+	gpu.step(12 >> sched.speed); //The JR NZ, from here on fuse steps the GPU
+	gpu_stepped = 12;
+	uint64_t done = 0;
+	while(done < k) {
+		const uint64_t before = (uint64_t(std::max(gpu.cycles_left(), 1)) << sched.speed) - 1;
+		const uint64_t whole = std::min(k - done, before / per);
+		if(whole) {
+			store(done, whole);
+			gpu.step(int(whole * per) >> sched.speed);
+			done += whole;
+			continue;
+		}
+		//This iteration changes the GPU mode. Vblank raises an interrupt and
+		//ends the frame and HBlank HDMA writes memory, those stay with decode.
+		if(gpu.vblank_next() || mmu.hdma_active) break;
+		for(int i=0;i<body.count;++i) {
+			if(i == body.store) store(done, 1);
+			gpu.step(body.cycles[i] >> sched.speed);
+		}
+		++done;
+	}
+	if(done == 0) return 0;
+
+	//Registers and flags as the last fused iteration left them
+	if(kind == COPY8 || kind == COPY16) {
+		regs.A = mmu.read8(regs.HL + done - 1);
+		regs.HL += done;
+		regs.DE += done;
+	} else if(kind == FILL8 || kind == CLEAR16) {
+		regs.HL += step * int(done);
+	}
+	if(counter8) {
+		*counter8 = dec(*counter8 - done + 1);
+	} else {
+		*counter16 -= done;
+		regs.A = OR(*counter16 >> 8, *counter16 & 0xFF);
+	}
+	fused += done * body.count;
+	gpu_stepped += done * per;
+	return done * per;
+}
@@ -1,9 +1,13 @@
 #include "gpu.h"
 #include "mmu.h"
+#include "state.h"
+#include "profile.h"
+#include "timeline.h"
+#include "perf_counters.h"
 #include <cstdio>
 #include <cstring>
 
-GB::GPU::GPU(MMU &mmu) : mmu(mmu) {
+GB::GPU::GPU(MMU &mmu) : mmu(mmu), skip_render(false), profile(nullptr), perf(nullptr) {
 	reset();
 }
 
@@ -14,7 +18,9 @@ bool GB::GPU::is_frame_done() {
 }
 
 void GB::GPU::reset() {
-	memset(vram, 0, 8192);
+	memset(vram, 0, sizeof(vram));
+	memset(vram_dirty, 1, sizeof(vram_dirty));
+	vram_bank = vram;
 	memset(oam, 0, 160);
 	memset(framebuffer, 255, 160*144*sizeof(RGB));
 
@@ -22,20 +28,72 @@ void GB::GPU::reset() {
 	clock = 0;
 	mode = 3;
 	frame_done = false;
+
+	memset(bg_pal, 0xFF, sizeof(bg_pal));
+	memset(obj_pal, 0xFF, sizeof(obj_pal));
+	bcps = 0;
+	ocps = 0;
+	for(int i=0;i<64;i+=2) {
+		update_bg_rgb(i);
+	}
 }
 
-void GB::GPU::write_fb(IO &io) {
-	for(int y=0;y<144;++y) {
-		for(int x=0;x<160;++x) {
-			for(int iy = 0; iy < 4; iy++) {
-				for(int ix = 0; ix < 4; ix++) {
-					io.set_px(x*4+ix,y*4+iy,framebuffer[y*160+x]);
-				}
-			}
-		}
+void GB::GPU::save(StateWriter &w) {
+	w.put(vram, sizeof(vram), vram_dirty);
+	w.put<uint8_t>(vram_bank == vram ? 0 : 1);
+	w.put(oam, sizeof(oam));
+	w.put(current_line);
+	w.put(clock);
+	w.put(mode);
+	w.put(x_scrl);
+	w.put(y_scrl);
+	w.put(wnd_x);
+	w.put(wnd_y);
+	w.put(lyc);
+	w.put(frame_done);
+	w.put(lcdc);
+	w.put(bg_pal, sizeof(bg_pal));
+	w.put(obj_pal, sizeof(obj_pal));
+	w.put(bcps);
+	w.put(ocps);
+}
+
+void GB::GPU::load(StateReader &r) {
+	uint8_t bank = 0;
+	r.get(vram, sizeof(vram));
+	memset(vram_dirty, 1, sizeof(vram_dirty));
+	r.get(bank);
+	vram_bank = vram + (bank & 0x01) * 0x2000;
+	r.get(oam, sizeof(oam));
+	r.get(current_line);
+	r.get(clock);
+	r.get(mode);
+	r.get(x_scrl);
+	r.get(y_scrl);
+	r.get(wnd_x);
+	r.get(wnd_y);
+	r.get(lyc);
+	r.get(frame_done);
+	r.get(lcdc);
+	r.get(bg_pal, sizeof(bg_pal));
+	r.get(obj_pal, sizeof(obj_pal));
+	r.get(bcps);
+	r.get(ocps);
+	for(int i=0;i<64;i+=2) {
+		update_bg_rgb(i);
 	}
 }
 
+void GB::GPU::update_bg_rgb(int index) {
+	const int p = index >> 3;
+	const int c = (index >> 1) & 0x03;
+	const uint16_t v = bg_pal[p*8 + c*2] | (bg_pal[p*8 + c*2 + 1] << 8);
+	const uint8_t r = v & 0x1F;
+	const uint8_t g = (v >> 5) & 0x1F;
+	const uint8_t b = (v >> 10) & 0x1F;
+	bg_rgb[p][c] = {(uint8_t)(r << 3 | r >> 2), (uint8_t)(g << 3 | g >> 2), (uint8_t)(b << 3 | b >> 2)};
+}
+
 void GB::GPU::step(int cycles) {
 	clock += cycles;
 
@@ -47,7 +105,7 @@ void GB::GPU::step(int cycles) {
 				if(current_line == 144) {
 					mode = 1;
 					frame_done = true;
-					mmu.write8(0xFF0F, mmu.read8(0xFF0F) | 0x01); //V-blank int
+					mmu.IF |= 0x01; //V-blank int
 				} else {
 					mode = 2;
 				}
@@ -73,14 +131,36 @@ void GB::GPU::step(int cycles) {
 			if(clock >= 172) {
 				clock -= 172;
 				mode = 0;
-				render_line();
+				if(profile && !skip_render) {
+					const uint64_t start = ticks();
+					render_line();
+					profile->ppu += ticks() - start;
+				} else if(perf && !skip_render) {
+					PerfSample start, end;
+					perf->read(start);
+					render_line();
+					perf->read(end);
+					perf->ppu.add(end.since(start));
+				} else if(!skip_render) {
+					TimelineScope scope(PHASE_PPU);
+					render_line();
+				}
+				if(!LCD_ON) { //Emulated state, also when skip_render leaves the pixels
+					if(clock >= 70224) {
+						frame_done = true;
+						clock -= 70224;
+					}
+					current_line = 0;
+					mode = 1;
+				}
+				mmu.hblank();
 			}
 			break;
 	}
 }
 
 uint8_t GB::GPU::read8(uint16_t addr) {
-	     if(addr >= 0x8000 && addr < 0xA000) return vram[addr & 0x1FFF]; //VRAM
+	     if(addr >= 0x8000 && addr < 0xA000) return vram_bank[addr & 0x1FFF]; //VRAM
 	else if(addr >= 0xFE00 && addr < 0xFEA0) return oam[addr & 0xFF];    //OAM (Object Attribute Memory)
 
 	//else if(addr >= 0xFF00 && addr < 0xFF80); //MMIO
@@ -100,6 +180,16 @@ uint8_t GB::GPU::read8(uint16_t addr) {
 		return wnd_y;
 	} else if(addr == 0xFF4B) {
 		return wnd_x;
+	} else if(addr == 0xFF4F) {
+		return vram_bank == vram ? 0xFE : 0xFF;
+	} else if(addr == 0xFF68) {
+		return bcps | 0x40;
+	} else if(addr == 0xFF69) {
+		return bg_pal[bcps & 0x3F];
+	} else if(addr == 0xFF6A) {
+		return ocps | 0x40;
+	} else if(addr == 0xFF6B) {
+		return obj_pal[ocps & 0x3F];
 	}
 
 	printf("[gpu read] [addr 0x%X]\n",addr);
@@ -107,7 +197,10 @@ uint8_t GB::GPU::read8(uint16_t addr) {
 }
 
 void GB::GPU::write8(uint16_t addr, uint8_t value) {
-	     if(addr >= 0x8000 && addr < 0xA000) vram[addr & 0x1FFF] = value; //VRAM
+	if(addr >= 0x8000 && addr < 0xA000) { //VRAM
+		vram_bank[addr & 0x1FFF] = value;
+		vram_dirty[(vram_bank - vram + (addr & 0x1FFF)) >> DIRTY_SHIFT] = 1;
+	}
 	else if(addr >= 0xFE00 && addr < 0xFEA0) oam[addr & 0xFF] = value;    //OAM (Object Attribute Memory)
 
 	//else if(addr >= 0xFF00 && addr < 0xFF80); //MMIO
@@ -131,6 +224,19 @@ void GB::GPU::write8(uint16_t addr, uint8_t value) {
 		wnd_y = value;
 	} else if(addr == 0xFF4B) {
 		wnd_x = value;
+	} else if(addr == 0xFF4F) {
+		vram_bank = vram + (value & 0x01) * 0x2000;
+	} else if(addr == 0xFF68) {
+		bcps = value & 0xBF;
+	} else if(addr == 0xFF69) {
+		bg_pal[bcps & 0x3F] = value;
+		update_bg_rgb(bcps & 0x3F);
+		if(bcps & 0x80) bcps = 0x80 | ((bcps + 1) & 0x3F);
+	} else if(addr == 0xFF6A) {
+		ocps = value & 0xBF;
+	} else if(addr == 0xFF6B) {
+		obj_pal[ocps & 0x3F] = value;
+		if(ocps & 0x80) ocps = 0x80 | ((ocps + 1) & 0x3F);
 	}
 
 	//TODO more registers
@@ -139,7 +245,9 @@ void GB::GPU::write8(uint16_t addr, uint8_t value) {
 
 void GB::GPU::render_line() {
 	if(LCD_ON) {
-		if(BG_ON) {
+		if(mmu.cgb) {
+			render_line_cgb();
+		} else if(BG_ON) {
 			const int tile_base = BG_TILE_BASE ? 0x0000 : 0x0800;
 			const int map_base = BG_MAP_BASE ? 0x1C00 : 0x1800;
 
@@ -177,13 +285,34 @@ void GB::GPU::render_line() {
 			}
 		}
 	} else {
-		//!LCD_ON
-		if(clock >= 70224) {
-			frame_done = true;
-			clock -= 70224;
-		}
+		//!LCD_ON, step does the rest
 		memset(framebuffer, 255, 160*144*sizeof(RGB));
-		current_line = 0;
-		mode = 1;
+	}
+}
+
+//On CGB the background is always drawn, LCDC bit 0 only affects sprite priority
+void GB::GPU::render_line_cgb() {
+	const int tile_base = BG_TILE_BASE ? 0x0000 : 0x0800;
+	const int map_base = BG_MAP_BASE ? 0x1C00 : 0x1800;
+
+	uint8_t bg_y = y_scrl + current_line; //Roll over
+	uint8_t tile_y = bg_y / 8;
+
+	for(int x=0; x < 160; ++x) {
+		uint8_t bg_x = x + x_scrl;
+		uint8_t tile_x = bg_x / 8;
+
+		const int entry = map_base + (tile_y*32) + tile_x;
+		uint8_t map = vram[entry];
+		const uint8_t attr = vram[0x2000 + entry]; //Palette, bank, flips
+		if(BG_TILE_BASE == 0) map ^= 0x80;
+
+		const uint8_t *tile = vram + ((attr & 0x08) ? 0x2000 : 0) + tile_base + (map*16);
+		const int offset_y = (attr & 0x40) ? 7 - bg_y % 8 : bg_y % 8;
+		const int color_bit = (attr & 0x20) ? bg_x % 8 : 7 - bg_x % 8;
+		const uint8_t *tile_line = tile + (offset_y*2);
+
+		const uint8_t color = ((tile_line[0] >> color_bit) & 1) | (((tile_line[1] >> color_bit) & 1) << 1);
+		framebuffer[(current_line*160)+x] = bg_rgb[attr & 0x07][color];
 	}
 }
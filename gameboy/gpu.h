@@ -1,14 +1,19 @@
 #pragma once
 
-#include "../IO.h"
 #include "../util.h"
 #include <cstdint>
 
 namespace GB {
 
 	struct MMU;
+	struct StateWriter;
+	struct StateReader;
+	struct Profile;
+	struct PerfCounters;
 	struct GPU {
-		uint8_t vram[8192]; //Video ram
+		uint8_t vram[2*8192]; //Video ram, bank 1 holds CGB tile attributes
+		uint8_t *vram_bank;   //Bank mapped at 0x8000
+		uint8_t vram_dirty[sizeof(vram) >> 8]; //Written 256 byte blocks, for Rewind
 		uint8_t oam[160];   //Object Attribute Memory
 		RGB framebuffer[160*144];
 
@@ -20,6 +25,15 @@ namespace GB {
 		uint8_t wnd_x, wnd_y;
 		uint8_t lyc;
 		bool frame_done;
+		bool skip_render; //Run the timing but leave the framebuffer alone
+		Profile *profile; //Times line rendering when set
+		PerfCounters *perf; //Counts line rendering into perf->ppu when set
+
+		//CGB palettes, 8 palettes of 4 colours in BGR555
+		uint8_t bg_pal[64];
+		uint8_t obj_pal[64];
+		uint8_t bcps, ocps; //Palette index with auto increment
+		RGB bg_rgb[8][4];   //bg_pal converted for rendering
 
 		union {
 			RegBit<7> LCD_ON;
@@ -34,15 +48,27 @@ namespace GB {
 		};
 
 		void render_line();
+		void render_line_cgb();
+		void update_bg_rgb(int index);
 	public:
-		void write_fb(IO &io);
 		GPU(MMU &mmu);
 
 		void reset();
+		void save(StateWriter &w);
+		void load(StateReader &r);
 		void step(int cycles);
 		uint8_t read8(uint16_t addr);
 		void write8(uint16_t addr, uint8_t value);
 
 		bool is_frame_done();
+
+		//Cycles until step changes mode, and whether that change starts vblank
+		inline int cycles_left() const {
+			static const int length[4] = {204, 456, 80, 172};
+			return length[mode & 3] - clock;
+		}
+		inline bool vblank_next() const {
+			return mode == 0 && current_line == 143;
+		}
 	};
 }
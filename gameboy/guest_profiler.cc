@@ -0,0 +1,97 @@
+#include "guest_profiler.h"
+#include <algorithm>
+
+GB::GuestProfiler::GuestProfiler(int period) : period(period < 64 ? 64 : period), jitter(0x9E3779B9), samples(0) {
+	countdown = this->period;
+}
+
+//RGBDS .sym file, lines of "bank:address name" and ; comments
+bool GB::GuestProfiler::load_symbols(const char *filename) {
+	FILE *fp = fopen(filename, "r");
+	if(!fp) return false;
+	char line[512];
+	while(fgets(line, sizeof(line), fp)) {
+		unsigned bank, addr;
+		char label[256];
+		if(line[0] == ';') continue;
+		if(sscanf(line, "%x:%x %255s", &bank, &addr, label) == 3) {
+			symbols[(bank << 16) | (addr & 0xFFFF)] = label;
+		}
+	}
+	fclose(fp);
+	return true;
+}
+
+void GB::GuestProfiler::clear() {
+	flat.clear();
+	folded.clear();
+	samples = 0;
+}
+
+void GB::GuestProfiler::sample(uint32_t pc, uint16_t sp) {
+	jitter ^= jitter << 13; //xorshift32
+	jitter ^= jitter >> 17;
+	jitter ^= jitter << 5;
+	countdown += period - period/8 + int(jitter % (period/4 + 1));
+
+	unwind(sp);
+	++samples;
+	++flat[pc];
+	path.clear();
+	if(!stack.empty()) path.push_back(stack.front().from);
+	for(const Frame &frame : stack) path.push_back(frame.addr);
+	path.push_back(pc);
+	++folded[path];
+}
+
+//The closest symbol at or below addr in the same bank, or bank:address
+std::string GB::GuestProfiler::name(uint32_t addr) const {
+	auto it = symbols.upper_bound(addr);
+	if(it != symbols.begin()) {
+		--it;
+		if((it->first >> 16) == (addr >> 16)) return it->second;
+	}
+	char buf[16];
+	snprintf(buf, sizeof(buf), "%02X:%04X", addr >> 16, addr & 0xFFFF);
+	return buf;
+}
+
+//Samples per symbol (per address without symbols), most first
+void GB::GuestProfiler::write_flat(FILE *fp, int top) const {
+	std::map<std::string, uint64_t> by_name;
+	for(const auto &entry : flat) {
+		by_name[name(entry.first)] += entry.second;
+	}
+	std::vector<std::pair<std::string, uint64_t>> sorted(by_name.begin(), by_name.end());
+	std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, uint64_t> &a, const std::pair<std::string, uint64_t> &b) {
+		return a.second > b.second;
+	});
+
+	fprintf(fp, "%llu samples, one per %d cycles\n", (unsigned long long)samples, period);
+	fprintf(fp, "%10s %7s  %s\n", "samples", "%", "location");
+	for(size_t i=0;i<sorted.size() && (top <= 0 || int(i) < top);++i) {
+		fprintf(fp, "%10llu %6.2f%%  %s\n", (unsigned long long)sorted[i].second,
+			samples ? sorted[i].second * 100.0 / samples : 0.0, sorted[i].first.c_str());
+	}
+}
+
+//One "outer;...;inner count" line per distinct stack, as flamegraph.pl reads
+//them. The pc is left out when it resolves to the function it is in.
+void GB::GuestProfiler::write_folded(FILE *fp) const {
+	std::map<std::string, uint64_t> lines;
+	for(const auto &entry : folded) {
+		const std::vector<uint32_t> &addrs = entry.first;
+		std::string line, last;
+		for(size_t i=0;i<addrs.size();++i) {
+			const std::string frame = name(addrs[i]);
+			if(i + 1 == addrs.size() && i > 1 && frame == last) break;
+			if(!line.empty()) line += ';';
+			line += frame;
+			last = frame;
+		}
+		lines[line] += entry.second;
+	}
+	for(const auto &line : lines) {
+		fprintf(fp, "%s %llu\n", line.first.c_str(), (unsigned long long)line.second);
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace GB {
+
+	//Samples where the guest spends its time. Every period emulated cycles
+	//(with a little jitter so loops in step with it are not aliased) the pc
+	//is recorded as bank:address along with a shadow call stack.
+	//
+	//The shadow stack is pushed on CALL, RST and interrupts and remembers
+	//the stack pointer just after the return address went on. A frame is
+	//gone once the stack pointer moved above it, which covers RET, RETI and
+	//code that drops return addresses or reloads SP itself. Stacks start at
+	//the caller of the outermost frame and end at the sampled pc.
+	struct GuestProfiler {
+		struct Frame {
+			uint32_t addr; //bank << 16 | address
+			uint32_t from; //Where the call was made
+			uint16_t sp;
+		};
+
+		struct PathHash {
+			size_t operator()(const std::vector<uint32_t> &path) const {
+				size_t h = 14695981039346656037ULL;
+				for(uint32_t addr : path) h = (h ^ addr) * 1099511628211ULL;
+				return h;
+			}
+		};
+
+		int period;
+		int countdown;
+		uint32_t jitter;
+		std::vector<Frame> stack;
+		std::vector<uint32_t> path; //Scratch, caller and frames outermost first, pc last
+		std::unordered_map<uint32_t, uint64_t> flat;
+		std::unordered_map<std::vector<uint32_t>, uint64_t, PathHash> folded;
+		std::map<uint32_t, std::string> symbols;
+		uint64_t samples;
+
+		static const size_t max_depth = 256;
+
+		//Frames whose return address was popped
+		inline void unwind(uint16_t sp) {
+			while(!stack.empty() && stack.back().sp < sp) stack.pop_back();
+		}
+
+		std::string name(uint32_t addr) const;
+	public:
+		GuestProfiler(int period = 4096);
+
+		bool load_symbols(const char *filename);
+		void clear();
+
+		//A call from from to target, sp already holds the return address
+		inline void enter(uint32_t target, uint32_t from, uint16_t sp) {
+			while(!stack.empty() && stack.back().sp <= sp) stack.pop_back();
+			if(stack.size() == max_depth) stack.erase(stack.begin());
+			stack.push_back(Frame{target, from, sp});
+		}
+
+		//Called after every instruction with the cycles it took, true when
+		//the next sample is due
+		inline bool tick(int cycles) {
+			countdown -= cycles;
+			return countdown <= 0;
+		}
+
+		void sample(uint32_t pc, uint16_t sp);
+
+		void write_flat(FILE *fp, int top = 0) const;
+		void write_folded(FILE *fp) const;
+	};
+}
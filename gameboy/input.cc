@@ -1,44 +1,78 @@
 #include "input.h"
-#include <SDL.h>
+#include "mmu.h"
+#include "state.h"
+#include "latency.h"
 
-GB::Input::Input() {
-	P1 = 0xFF;
+GB::Input::Input(MMU &mmu) : mmu(mmu), source(nullptr), latency(nullptr) {
+	buttons = 0;
+	select = 0x30;
+	for(int i=0;i<4;++i) {
+		lines[i] = 0x0F;
+	}
+	reset();
 }
 
-void GB::Input::step() {
+void GB::Input::reset() {
+	select = 0x30;
+	update(buttons, select);
 }
 
-uint8_t GB::Input::read8(uint16_t addr) {
-	if(addr != 0xFF00) return 0;
+void GB::Input::save(StateWriter &w) {
+	w.put(buttons);
+	w.put(select);
+}
 
-	const uint8_t *keys = SDL_GetKeyboardState(NULL);
-	P1 |= 0x0F;
-
-	if((P1 & 0x10) == 0) { //P14
-		if(keys[SDL_SCANCODE_RIGHT])
-			P1 &= ~0x01;
-		if(keys[SDL_SCANCODE_LEFT])
-			P1 &= ~0x02;
-		if(keys[SDL_SCANCODE_UP])
-			P1 &= ~0x04;
-		if(keys[SDL_SCANCODE_DOWN])
-			P1 &= ~0x08;
+void GB::Input::load(StateReader &r) {
+	uint8_t new_buttons = 0;
+	uint8_t new_select = 0x30;
+	r.get(new_buttons);
+	r.get(new_select);
+	for(int i=0;i<4;++i) {
+		lines[i] = 0; //Nothing can fall from low, so no interrupt
 	}
-	if((P1 & 0x20) == 0) { //P15
-		if(keys[SDL_SCANCODE_Z]) //A
-			P1 &= ~0x01;
-		if(keys[SDL_SCANCODE_X]) //B
-			P1 &= ~0x02;
-		if(keys[SDL_SCANCODE_RETURN]) //SELECT
-			P1 &= ~0x04;
-		if(keys[SDL_SCANCODE_SPACE]) //START
-			P1 &= ~0x08;
+	update(new_buttons, new_select);
+}
+
+//Recompute the P1 lookup and raise the joypad interrupt on any high to low line
+void GB::Input::update(uint8_t new_buttons, uint8_t new_select) {
+	const uint8_t before = lines[select >> 4];
+
+	buttons = new_buttons;
+	select = new_select;
+	for(int i=0;i<4;++i) {
+		uint8_t pressed = 0;
+		if((i & 0x01) == 0) pressed |= buttons & 0x0F; //P14 low selects the d-pad
+		if((i & 0x02) == 0) pressed |= buttons >> 4;   //P15 low selects the buttons
+		lines[i] = ~pressed & 0x0F;
 	}
 
-	return P1;
+	if(before & ~lines[select >> 4])
+		mmu.IF |= 0x10; //Joypad int
+}
+
+//Take a snapshot of the source, once per frame
+void GB::Input::latch() {
+	if(source) update(source->poll(), select);
+}
+
+void GB::Input::set_buttons(uint8_t state) {
+	update(state, select);
+}
+
+uint8_t GB::Input::read8(uint16_t addr) {
+	if(addr != 0xFF00) return 0;
+	return 0xC0 | select | lines[select >> 4];
+}
+
+//The guest read P1, MMU::read_slow calls this when latency is set
+void GB::Input::observed() {
+	uint8_t visible = 0;
+	if(!(select & 0x10)) visible |= 0x0F;
+	if(!(select & 0x20)) visible |= 0xF0;
+	latency->read(buttons & visible);
 }
 
 void GB::Input::write8(uint16_t addr, uint8_t value) {
 	if(addr == 0xFF00)
-		P1 = value;
+		update(buttons, value & 0x30);
 }
@@ -3,12 +3,48 @@
 
 namespace GB {
 
+	//Packed button state, a set bit means pressed
+	enum Button {
+		BUTTON_RIGHT  = 0x01,
+		BUTTON_LEFT   = 0x02,
+		BUTTON_UP     = 0x04,
+		BUTTON_DOWN   = 0x08,
+		BUTTON_A      = 0x10,
+		BUTTON_B      = 0x20,
+		BUTTON_SELECT = 0x40,
+		BUTTON_START  = 0x80
+	};
+
+	//Where button state comes from (keyboard, replay file, API), polled once per frame
+	struct InputSource {
+		virtual ~InputSource() {}
+		virtual uint8_t poll() = 0;
+	};
+
+	struct MMU;
+	struct StateWriter;
+	struct StateReader;
+	struct Latency;
 	struct Input {
-		uint8_t P1;
+		MMU &mmu;
+		uint8_t buttons;  //Latched state
+		uint8_t select;   //P14/P15 as last written
+		uint8_t lines[4]; //P10-P13 for every P14/P15 combination
+
+		void update(uint8_t new_buttons, uint8_t new_select);
 	public:
-		Input();
-		void step();
+		InputSource *source;
+		Latency *latency; //Told what every guest P1 read shows when set
+
+		Input(MMU &mmu);
+
+		void reset();
+		void save(StateWriter &w);
+		void load(StateReader &r);
+		void latch();
+		void set_buttons(uint8_t state);
 		uint8_t read8(uint16_t addr);
+		void observed();
 		void write8(uint16_t addr, uint8_t value);
 	};
 }
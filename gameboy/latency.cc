@@ -0,0 +1,95 @@
+#include "latency.h"
+#include "movie.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+	const char *stage_names[GB::Latency::STAGES] = {"read", "frame", "present"};
+
+	//Frames to wait for a read press to change the picture before giving up
+	const int max_frames_waited = 120;
+
+	double percentile(const std::vector<uint64_t> &sorted, double p) {
+		if(sorted.empty()) return 0;
+		size_t rank = size_t(p / 100.0 * sorted.size() + 0.5);
+		if(rank > 0) --rank;
+		return sorted[std::min(rank, sorted.size() - 1)] / 1e6;
+	}
+}
+
+GB::Latency::Latency() : stage(STAGE_IDLE), pending(0), event_time(0), baseline(0), last_hash(0), frames_waited(0), abandoned(0), fake(false), fake_now(0), period(0) {
+}
+
+uint64_t GB::Latency::now() const {
+	if(fake) return fake_now;
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//Time only moves on tick, one present period at a time
+void GB::Latency::use_fake_clock(uint64_t period_ns) {
+	fake = true;
+	period = period_ns;
+}
+
+void GB::Latency::tick() {
+	fake_now += period;
+}
+
+//Buttons went down on the host. A press the guest has not read yet is
+//given up for the new one.
+void GB::Latency::event(uint8_t pressed) {
+	if(!pressed) return;
+	if(stage == STAGE_READ) ++abandoned;
+	else if(stage != STAGE_IDLE) return;
+	stage = STAGE_READ;
+	pending = pressed;
+	event_time = now();
+}
+
+void GB::Latency::observed() {
+	samples[STAGE_READ].push_back(now() - event_time);
+	baseline = last_hash;
+	frames_waited = 0;
+	stage = STAGE_FRAME;
+}
+
+//End of a frame, with the picture that will be presented
+void GB::Latency::frame(const void *framebuffer, size_t size) {
+	last_hash = Movie::hash(framebuffer, size);
+	if(stage != STAGE_FRAME) return;
+	if(last_hash != baseline) {
+		samples[STAGE_FRAME].push_back(now() - event_time);
+		stage = STAGE_PRESENT;
+	} else if(++frames_waited > max_frames_waited) {
+		++abandoned;
+		stage = STAGE_IDLE;
+	}
+}
+
+void GB::Latency::present() {
+	if(stage != STAGE_PRESENT) return;
+	samples[STAGE_PRESENT].push_back(now() - event_time);
+	stage = STAGE_IDLE;
+}
+
+//Percentiles of every stage in ms
+void GB::Latency::report(FILE *fp) const {
+	fprintf(fp, "latency from input event, ms%s\n", fake ? " (fake present clock)" : "");
+	fprintf(fp, "%-8s %8s %8s %8s %8s %8s\n", "stage", "samples", "p50", "p90", "p99", "max");
+	for(int i=0;i<STAGES;++i) {
+		std::vector<uint64_t> sorted = samples[i];
+		std::sort(sorted.begin(), sorted.end());
+		fprintf(fp, "%-8s %8zu %8.2f %8.2f %8.2f %8.2f\n", stage_names[i], sorted.size(),
+			percentile(sorted, 50), percentile(sorted, 90), percentile(sorted, 99), percentile(sorted, 100));
+	}
+	fprintf(fp, "%llu press(es) abandoned\n", (unsigned long long)abandoned);
+}
+
+GB::LatencyDriver::LatencyDriver(Latency &latency, int period, uint8_t button) : latency(latency), period(period > 1 ? period : 2), button(button), frames(0) {
+}
+
+uint8_t GB::LatencyDriver::poll() {
+	const uint64_t at = frames++ % period;
+	if(at == 0) latency.event(button);
+	return at < uint64_t(period / 2) ? button : 0;
+}
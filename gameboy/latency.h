@@ -0,0 +1,71 @@
+#pragma once
+#include "input.h"
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+namespace GB {
+
+	//Input to photon latency. One press is followed at a time through the
+	//first read of P1 that shows it to the guest, the first frame whose
+	//picture differs after that read and the present that puts it on screen.
+	//Every stage is timed from the host input event.
+	//
+	//The clock is steady_clock, or with a fake clock a present clock that
+	//the caller ticks once per refresh, so headless runs measure whole frames
+	//and repeat exactly.
+	struct Latency {
+		enum {
+			STAGE_READ,
+			STAGE_FRAME,
+			STAGE_PRESENT,
+			STAGES,
+			STAGE_IDLE = STAGES
+		};
+
+		std::vector<uint64_t> samples[STAGES]; //ns after the event
+		int stage;           //Waiting for this one
+		uint8_t pending;     //Buttons of the press followed
+		uint64_t event_time;
+		uint64_t baseline;   //Picture before the read
+		uint64_t last_hash;  //Picture of the last frame
+		int frames_waited;
+		uint64_t abandoned;  //Presses the guest never read or never showed
+		bool fake;
+		uint64_t fake_now;
+		uint64_t period;
+
+		uint64_t now() const;
+		void observed();
+	public:
+		Latency();
+
+		void use_fake_clock(uint64_t period_ns = 16742706);
+		void tick();
+
+		void event(uint8_t pressed);
+		void frame(const void *framebuffer, size_t size);
+		void present();
+
+		//Called by Input with the pressed buttons P1 lets the guest see
+		inline void read(uint8_t visible) {
+			if(stage == STAGE_READ && (visible & pending)) observed();
+		}
+
+		void report(FILE *fp) const;
+	};
+
+	//Presses button for half of every period frames, a repeatable stand in
+	//for a player that tells latency about every press
+	struct LatencyDriver : InputSource {
+		Latency &latency;
+		int period;
+		uint8_t button;
+		uint64_t frames;
+	public:
+		LatencyDriver(Latency &latency, int period, uint8_t button = BUTTON_A);
+
+		uint8_t poll();
+	};
+}
@@ -0,0 +1,89 @@
+#include "libgbm.h"
+#include "system.h"
+#include <new>
+
+struct gbm {
+	GB::System *system;
+};
+
+static_assert(sizeof(RGB) == 3, "gbm_framebuffer hands out RGB as packed bytes");
+
+int gbm_api_version(void) {
+	return GBM_API_VERSION;
+}
+
+//No exception may cross into C
+gbm* gbm_create(void) {
+	gbm *g = new (std::nothrow) gbm;
+	if(!g) return nullptr;
+	try {
+		g->system = new GB::System();
+	} catch(...) {
+		delete g;
+		return nullptr;
+	}
+	return g;
+}
+
+void gbm_destroy(gbm *g) {
+	if(!g) return;
+	delete g->system;
+	delete g;
+}
+
+gbm* gbm_clone(gbm *g) {
+	gbm *c = gbm_create();
+	if(c) c->system->copy(*g->system);
+	return c;
+}
+
+int gbm_load_rom(gbm *g, const void *data, size_t size) {
+	return g->system->load(static_cast<const uint8_t*>(data), size) ? 0 : -1;
+}
+
+void gbm_reset(gbm *g) {
+	g->system->reset();
+}
+
+int gbm_run_frames(gbm *g, int frames) {
+	if(!g->system->cart.rom) return 0;
+	int i = 0;
+	for(;i<frames;++i) {
+		if(g->system->run_frame() == 0) break;
+	}
+	return i;
+}
+
+long gbm_run_cycles(gbm *g, long cycles) {
+	if(!g->system->cart.rom) return 0;
+	return g->system->run_cycles(cycles);
+}
+
+void gbm_set_buttons(gbm *g, uint8_t buttons) {
+	g->system->input.set_buttons(buttons);
+}
+
+const uint8_t* gbm_framebuffer(gbm *g) {
+	return reinterpret_cast<const uint8_t*>(g->system->gpu.framebuffer);
+}
+
+uint8_t gbm_read8(gbm *g, uint16_t addr) {
+	return g->system->mmu.read8(addr);
+}
+
+void gbm_write8(gbm *g, uint16_t addr, uint8_t value) {
+	g->system->mmu.write8(addr, value);
+}
+
+size_t gbm_state_size(gbm *g) {
+	return g->system->state_size();
+}
+
+size_t gbm_save_state(gbm *g, void *buf, size_t size) {
+	if(size < g->system->state_size()) return 0;
+	return g->system->save_state(static_cast<uint8_t*>(buf));
+}
+
+int gbm_load_state(gbm *g, const void *buf, size_t size) {
+	return g->system->load_state(static_cast<const uint8_t*>(buf), size) ? 0 : -1;
+}
@@ -0,0 +1,62 @@
+#pragma once
+/* C interface to the emulator core, for driving it in-process from other
+ * languages and harnesses. Everything is synchronous and an instance must
+ * only be used by one thread at a time; separate instances are independent.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GBM_API_VERSION 1
+
+#define GBM_SCREEN_WIDTH  160
+#define GBM_SCREEN_HEIGHT 144
+
+/* Bits for gbm_set_buttons, a set bit means pressed */
+#define GBM_BUTTON_RIGHT  0x01
+#define GBM_BUTTON_LEFT   0x02
+#define GBM_BUTTON_UP     0x04
+#define GBM_BUTTON_DOWN   0x08
+#define GBM_BUTTON_A      0x10
+#define GBM_BUTTON_B      0x20
+#define GBM_BUTTON_SELECT 0x40
+#define GBM_BUTTON_START  0x80
+
+typedef struct gbm gbm;
+
+int gbm_api_version(void);
+
+gbm* gbm_create(void);
+void gbm_destroy(gbm *g);
+gbm* gbm_clone(gbm *g); /* Same rom (shared) and state */
+
+/* The rom is copied. Returns 0 on success. */
+int gbm_load_rom(gbm *g, const void *data, size_t size);
+void gbm_reset(gbm *g);
+
+/* Return the frames or cycles run, less than asked on an invalid opcode */
+int gbm_run_frames(gbm *g, int frames);
+long gbm_run_cycles(gbm *g, long cycles);
+
+void gbm_set_buttons(gbm *g, uint8_t buttons);
+
+/* Packed 8 bit RGB, GBM_SCREEN_WIDTH*GBM_SCREEN_HEIGHT pixels, valid until
+ * the instance is destroyed */
+const uint8_t* gbm_framebuffer(gbm *g);
+
+/* Guest memory as the cpu sees it, including side effects of MMIO */
+uint8_t gbm_read8(gbm *g, uint16_t addr);
+void gbm_write8(gbm *g, uint16_t addr, uint8_t value);
+
+/* States have a fixed size per rom. Save returns the bytes written, 0 if
+ * buf is too small; load returns 0 on success. */
+size_t gbm_state_size(gbm *g);
+size_t gbm_save_state(gbm *g, void *buf, size_t size);
+int gbm_load_state(gbm *g, const void *buf, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,65 +1,324 @@
 #include "mmu.h"
+#include "scheduler.h"
 #include "cart.h"
 #include "gpu.h"
 #include "input.h"
+#include "timer.h"
+#include "apu.h"
+#include "state.h"
+#include "profile.h"
+#include "debugger.h"
+#include "access_stats.h"
 #include <cstring>
 
-GB::MMU::MMU(Cart& cart, GPU& gpu, Input& input) : cart(cart), gpu(gpu), input(input) {
+GB::MMU::MMU(Scheduler& sched, Cart& cart, GPU& gpu, Input& input, Timer& timer, APU& apu) : profile(nullptr), debugger(nullptr), stats(nullptr), sched(sched), cart(cart), gpu(gpu), input(input), timer(timer), apu(apu) {
+	sched.bind(EVENT_DMA, &MMU::dma_done, this);
+	memset(watch_page, 0, sizeof(watch_page));
 	reset();
 }
 
 void GB::MMU::reset() {
-	memset(wram, 0, 8192);
+	memset(wram, 0, sizeof(wram));
+	memset(wram_dirty, 1, sizeof(wram_dirty));
 	memset(zram, 0, 128);
 	IF = 0;
+	dma_src = 0;
+	dma_active = false;
+	sched.cancel(EVENT_DMA);
+
+	cgb = cart.is_cgb();
+	key1 = 0;
+	svbk = 0;
+	hdma_src = 0;
+	hdma_dst = 0x8000;
+	hdma_len = 0x7F;
+	hdma_active = false;
+	stall = 0;
+	sched.set_speed(0);
+
+	map();
+}
+
+void GB::MMU::save(StateWriter &w) {
+	w.put(wram, sizeof(wram), wram_dirty);
+	w.put(zram, sizeof(zram));
+	w.put(IF);
+	w.put(dma_src);
+	w.put(dma_active);
+	w.put(cgb);
+	w.put(key1);
+	w.put(svbk);
+	w.put(hdma_src);
+	w.put(hdma_dst);
+	w.put(hdma_len);
+	w.put(hdma_active);
+	w.put(stall);
+}
+
+//Expects the cart and GPU to be loaded already, their banks feed the page tables
+void GB::MMU::load(StateReader &r) {
+	r.get(wram, sizeof(wram));
+	memset(wram_dirty, 1, sizeof(wram_dirty));
+	r.get(zram, sizeof(zram));
+	r.get(IF);
+	r.get(dma_src);
+	r.get(dma_active);
+	r.get(cgb);
+	r.get(key1);
+	r.get(svbk);
+	r.get(hdma_src);
+	r.get(hdma_dst);
+	r.get(hdma_len);
+	r.get(hdma_active);
+	r.get(stall);
+	map();
+}
+
+//Rebuild the page tables, called whenever a bank or the DMA state changes
+void GB::MMU::map() {
+	for(int i=0;i<16;++i) {
+		page[i] = nullptr;
+		dirty_page[i] = dirty_sink;
+	}
+
+	if(cart.rom) {
+		for(int i=0;i<4;++i) {
+			if(size_t(i+1)*0x1000 <= cart.rom_size)
+				page[0x0+i] = cart.rom + i*0x1000;               //Rom, bank 0
+			if(cart.rom_offset + (i+1)*0x1000 <= cart.rom_size)
+				page[0x4+i] = cart.rom + cart.rom_offset + i*0x1000; //Rom, bank 1
+		}
+		for(int i=0;i<2;++i) {
+			if(cart.ram_offset + (i+1)*0x1000 <= cart.eram_size()) {
+				page[0xA+i] = cart.eram + cart.ram_offset + i*0x1000; //External cartridge ram
+				dirty_page[0xA+i] = cart.eram_dirty + ((cart.ram_offset + i*0x1000) >> DIRTY_SHIFT);
+			}
+		}
+	}
+
+	page[0x8] = gpu.vram_bank;          //VRAM
+	page[0x9] = gpu.vram_bank + 0x1000;
+	dirty_page[0x8] = gpu.vram_dirty + ((gpu.vram_bank - gpu.vram) >> DIRTY_SHIFT);
+	dirty_page[0x9] = dirty_page[0x8] + 16;
+
+	const int bank = (cgb && (svbk & 0x07)) ? (svbk & 0x07) : 1;
+	page[0xC] = wram;                   //Working ram, bank 0
+	page[0xD] = wram + bank*0x1000;     //Working ram, bank 1-7
+	page[0xE] = page[0xC];              //Shadow working ram
+	dirty_page[0xC] = wram_dirty;
+	dirty_page[0xD] = wram_dirty + bank*16;
+	dirty_page[0xE] = dirty_page[0xC];
+	//0xF000 mixes shadow ram, OAM, MMIO and zero ram and always takes the slow path
+
+	for(int i=0;i<16;++i) {
+		page_bank[i] = 0;
+	}
+	for(int i=0x4;i<0x8;++i) {
+		page_bank[i] = cart.rom_offset >> 14;
+	}
+	page_bank[0x8] = page_bank[0x9] = (gpu.vram_bank - gpu.vram) >> 13;
+	page_bank[0xA] = page_bank[0xB] = cart.ram_offset >> 13;
+	page_bank[0xD] = bank;
+
+	for(int i=0;i<16;++i) {
+		read_page[i] = dma_active ? nullptr : page[i]; //Bus conflict with OAM DMA
+		write_page[i] = read_page[i];
+	}
+	for(int i=0;i<8;++i) {
+		write_page[i] = nullptr; //Rom writes go to the MBC
+	}
+	if(cart.mbc_type.mbc == 2) {
+		write_page[0xA] = write_page[0xB] = nullptr; //MBC2 ram is 4 bits wide
+	}
+	for(int i=0;i<16;++i) {
+		if(stats || (watch_page[i] & WATCH_READ)) read_page[i] = nullptr;
+		if(stats || (watch_page[i] & WATCH_WRITE)) write_page[i] = nullptr;
+	}
+}
+
+//Backing memory for an address, nullptr if it is not plain memory
+const uint8_t* GB::MMU::resolve(uint16_t addr) {
+	const uint8_t *p = page[addr >> 12];
+	return p ? p + (addr & 0x0FFF) : nullptr;
+}
+
+//The whole transfer happens at once, the 160 machine cycles it takes on
+//hardware are only modelled as a window in which the bus is unavailable.
+void GB::MMU::dma(uint8_t value) {
+	dma_src = value;
+	uint16_t src = value << 8;
+	if(src >= 0xE000) src -= 0x2000; //DMA sees the shadow of working ram up there
+	const uint8_t *p = resolve(src);
+	if(p) {
+		memcpy(gpu.oam, p, 160);
+	} else {
+		dma_active = false;
+		for(int i=0;i<160;++i) {
+			gpu.oam[i] = read_io(src + i);
+		}
+	}
+	dma_active = true;
+	map();
+	sched.schedule(EVENT_DMA, sched.now + 640);
 }
 
-uint8_t GB::MMU::read8(uint16_t addr) {
+void GB::MMU::dma_done(void *ctx, uint64_t /*when*/) {
+	MMU *mmu = static_cast<MMU*>(ctx);
+	mmu->dma_active = false;
+	mmu->map();
+}
+
+//STOP with KEY1 armed, returns whether the speed changed
+bool GB::MMU::switch_speed() {
+	if(!cgb || !(key1 & 0x01)) return false;
+	const int speed = (key1 & 0x80) ? 0 : 1;
+	key1 = speed << 7;
+	sched.set_speed(speed);
+	return true;
+}
+
+//Copy one 16 byte block into VRAM, blocks never straddle a page
+void GB::MMU::hdma_block() {
+	uint8_t *dst = gpu.vram_bank + (hdma_dst & 0x1FF0);
+	gpu.vram_dirty[(dst - gpu.vram) >> DIRTY_SHIFT] = 1;
+	const uint8_t *src = resolve(hdma_src);
+	if(src) {
+		memcpy(dst, src, 16);
+	} else {
+		for(int i=0;i<16;++i) {
+			dst[i] = read_io(hdma_src + i);
+		}
+	}
+	hdma_src += 16;
+	hdma_dst = 0x8000 | ((hdma_dst + 16) & 0x1FF0);
+	stall += 32 << sched.speed; //8us per block
+}
+
+void GB::MMU::hdma_start(uint8_t value) {
+	if(hdma_active && !(value & 0x80)) { //Cancel a running HBlank transfer
+		hdma_active = false;
+		return;
+	}
+	hdma_len = value & 0x7F;
+	if(value & 0x80) {
+		hdma_active = true;
+		return;
+	}
+	//General purpose, everything at once
+	for(int n=hdma_len;n>=0;--n) {
+		hdma_block();
+	}
+	hdma_len = 0x7F;
+}
+
+//Called by the GPU at the start of every HBlank
+void GB::MMU::hblank() {
+	if(!hdma_active) return;
+	hdma_block();
+	if(hdma_len-- == 0) {
+		hdma_active = false;
+		hdma_len = 0x7F;
+	}
+}
+
+uint8_t GB::MMU::read_slow(uint16_t addr) {
+	uint8_t value;
+	if(profile) {
+		const uint64_t start = ticks();
+		value = read_io(addr);
+		profile->mmu += ticks() - start;
+	} else {
+		value = read_io(addr);
+	}
+	if(stats) stats->read(addr);
+	if(watch_page[addr >> 12] & WATCH_READ) debugger->access(WATCH_READ, addr, value);
+	if(addr == 0xFF00 && input.latency) input.observed();
+	return value;
+}
+
+void GB::MMU::write_slow(uint16_t addr, uint8_t value) {
+	if(stats) stats->write(addr);
+	if(watch_page[addr >> 12] & WATCH_WRITE) debugger->access(WATCH_WRITE, addr, value);
+	if(!profile) return write_io(addr, value);
+	const uint64_t start = ticks();
+	write_io(addr, value);
+	profile->mmu += ticks() - start;
+}
+
+uint8_t GB::MMU::read_io(uint16_t addr) {
 	//TODO More memory things
+	if(dma_active && addr < 0xFF00) return 0xFF; //Bus conflict with OAM DMA
 
 	     if(addr >= 0x0000 && addr < 0x4000) return cart.read8(addr);    //Rom, bank 0
 	else if(addr >= 0x4000 && addr < 0x8000) return cart.read8(addr);    //Rom, bank 1
 	else if(addr >= 0x8000 && addr < 0xA000) return  gpu.read8(addr);    //VRAM
 	else if(addr >= 0xA000 && addr < 0xC000) return cart.read8(addr);    //External cartridge ram
-	else if(addr >= 0xC000 && addr < 0xE000) return wram[addr & 0x1FFF]; //working ram
-	else if(addr >= 0xE000 && addr < 0xFE00) return wram[addr & 0x1FFF]; //shadow working ram
+	else if(addr >= 0xC000 && addr < 0xFE00) return page[(addr >> 12) & 0xD][addr & 0x0FFF]; //(shadow) working ram
 	else if(addr >= 0xFE00 && addr < 0xFEA0) return gpu.read8(addr);     //OAM (Object Attribute Memory)
-	else if(addr >= 0xFEA0 && addr < 0xFF00) return 0;                   //Unusable
+	//else if(addr >= 0xFEA0 && addr < 0xFF00); //Unusable, reads the failure state
 	else if(addr == 0xFF00) return input.read8(addr);
+	else if(addr >= 0xFF04 && addr < 0xFF08) return timer.read8(addr); //DIV, TIMA, TMA, TAC
 	else if(addr == 0xFF0F) return IF;
+	else if(addr == 0xFF46) return dma_src;
+	else if(addr >= 0xFF10 && addr < 0xFF40) return apu.read8(addr); //Sound registers, wave ram
+
+	//START CGB REGS
+	else if(cgb && addr == 0xFF4D) return key1 | 0x7E;
+	else if(cgb && addr == 0xFF55) return (hdma_active ? 0x00 : 0x80) | hdma_len;
+	else if(cgb && addr == 0xFF70) return svbk | 0xF8;
+	//END CGB REGS
 	
 	//else if(addr >= 0xFF00 && addr < 0xFF80); //MMIO (TODO)
 	//START VIDEO REGS
 	else if(addr >= 0xFF40 && addr < 0xFF56) return gpu.read8(addr); //GPU register(s)
+	else if(addr >= 0xFF68 && addr < 0xFF6C) return gpu.read8(addr); //CGB palettes
 	//END VIDEO REGS
 
 	else if(addr >= 0xFF80 && addr <= 0xFFFF) return zram[addr & 0x7F];   //Zero ram
 
 	//printf("[mmu read] [addr 0x%X]\n",addr);
+	if(stats) stats->unmapped_read(addr);
 	return 0; //failure state
 }
 
-void GB::MMU::write8(uint16_t addr, uint8_t value) {
+void GB::MMU::write_io(uint16_t addr, uint8_t value) {
 	//TODO More memory things
+	if(dma_active && addr < 0xFF00) return; //Bus conflict with OAM DMA
 	
-	     if(addr >= 0x0000 && addr < 0x4000) cart.write8(addr, value);    //Rom, bank 0
-	else if(addr >= 0x4000 && addr < 0x8000) cart.write8(addr, value);    //Rom, bank 1
+	     if(addr >= 0x0000 && addr < 0x8000) { cart.write8(addr, value); map(); } //MBC, may switch banks
 	else if(addr >= 0x8000 && addr < 0xA000)  gpu.write8(addr, value);    //VRAM
 	else if(addr >= 0xA000 && addr < 0xC000) cart.write8(addr, value);    //External cartridge ram
-	else if(addr >= 0xC000 && addr < 0xE000) wram[addr & 0x1FFF] = value; //working ram
-	else if(addr >= 0xE000 && addr < 0xFE00) wram[addr & 0x1FFF] = value; //shadow working ram
+	else if(addr >= 0xC000 && addr < 0xFE00) { //(shadow) working ram
+		page[(addr >> 12) & 0xD][addr & 0x0FFF] = value;
+		dirty_page[(addr >> 12) & 0xD][(addr >> 8) & 0x0F] = 1;
+	}
 	else if(addr >= 0xFE00 && addr < 0xFEA0)  gpu.write8(addr, value);    //OAM (Object Attribute Memory)
 	//else if(addr >= 0xFEA0 && addr < 0xFF00); //Unusable
 	else if(addr == 0xFF00) input.write8(addr, value);
+	else if(addr >= 0xFF04 && addr < 0xFF08) timer.write8(addr, value); //DIV, TIMA, TMA, TAC
 	else if(addr == 0xFF0F) IF = value;
+	else if(addr == 0xFF46) dma(value);
+	else if(addr >= 0xFF10 && addr < 0xFF40) apu.write8(addr, value); //Sound registers, wave ram
+
+	//START CGB REGS
+	else if(cgb && addr == 0xFF4D) key1 = (key1 & 0x80) | (value & 0x01);
+	else if(cgb && addr == 0xFF4F) { gpu.write8(addr, value); map(); }
+	else if(cgb && addr == 0xFF51) hdma_src = (hdma_src & 0x00F0) | (value << 8);
+	else if(cgb && addr == 0xFF52) hdma_src = (hdma_src & 0xFF00) | (value & 0xF0);
+	else if(cgb && addr == 0xFF53) hdma_dst = 0x8000 | ((value & 0x1F) << 8) | (hdma_dst & 0x00F0);
+	else if(cgb && addr == 0xFF54) hdma_dst = (hdma_dst & 0xFF00) | (value & 0xF0);
+	else if(cgb && addr == 0xFF55) hdma_start(value);
+	else if(cgb && addr == 0xFF70) { svbk = value & 0x07; map(); }
+	else if(addr == 0xFF4F || (addr >= 0xFF51 && addr < 0xFF56) || (addr >= 0xFF68 && addr < 0xFF6C)) return; //DMG, kept from the GPU below
+	//END CGB REGS
 
 	//else if(addr >= 0xFF00 && addr < 0xFF80) printf("[mmu write] [addr 0x%X] [val 0x%X]\n",addr,value); //MMIO
 	//START VIDEO REGS
 	else if(addr >= 0xFF40 && addr < 0xFF56) gpu.write8(addr, value); //GPU register(s)
+	else if(addr >= 0xFF68 && addr < 0xFF6C) gpu.write8(addr, value); //CGB palettes
 	//END VIDEO REGS
 	else if(addr >= 0xFF80 && addr <= 0xFFFF) zram[addr & 0x7F] = value;   //Zero ram
-	
-	//failure state
+	else if(stats) stats->unmapped_write(addr); //failure state
 }
 
 uint16_t GB::MMU::read16(uint16_t addr) {
@@ -3,22 +3,102 @@
 
 namespace GB {
 
+	struct Scheduler;
 	struct Cart;
 	struct GPU;
 	struct Input;
+	struct Timer;
+	struct APU;
+	struct StateWriter;
+	struct StateReader;
+	struct Profile;
+	struct Debugger;
+	struct AccessStats;
+
+	//Kinds of access a Debugger watches
+	enum {
+		WATCH_READ = 1,
+		WATCH_WRITE = 2
+	};
+
 	struct MMU {
-		uint8_t wram[8192]; //Working ram
+		uint8_t wram[8*4096]; //Working ram, bank 0 and switchable banks 1-7 (CGB)
+		uint8_t wram_dirty[sizeof(wram) >> 8]; //Written 256 byte blocks, for Rewind
 		uint8_t zram[128];  //Zero (fast) ram
 		uint8_t IF;
+		uint8_t dma_src;
+		bool dma_active; //Only 0xFF00 and up is reachable while OAM DMA runs
+
+		//CGB
+		bool cgb;
+		uint8_t key1;     //Speed switch
+		uint8_t svbk;     //WRAM bank
+		uint16_t hdma_src;
+		uint16_t hdma_dst;
+		uint8_t hdma_len; //Remaining 16 byte blocks minus one
+		bool hdma_active; //HBlank transfer in progress
+		int stall;        //Cycles the cpu loses to a general purpose HDMA
+
+		//4KB pages. page is the backing memory of plain pages, read_page and
+		//write_page are the fast path; a nullptr there takes the slow path.
+		uint8_t *page[16];
+		uint8_t *read_page[16];
+		uint8_t *write_page[16];
+		uint8_t *dirty_page[16]; //Dirty flags of the 16 blocks of each page
+		uint8_t dirty_sink[16];  //For pages nobody tracks
+		uint16_t page_bank[16];  //Bank mapped in each page
+		uint8_t watch_page[16];  //Watched kinds of access, these stay on the slow path
+
+		Profile *profile; //Times the slow path when set
+		Debugger *debugger; //Owns watch_page
+		AccessStats *stats; //Counts every access when set, all pages take the slow path
+
+		Scheduler& sched;
 		Cart& cart;
 		GPU& gpu;
 		Input& input;
+		Timer& timer;
+		APU& apu;
+
+		void dma(uint8_t page);
+		static void dma_done(void *ctx, uint64_t when);
+		void hdma_block();
+		void hdma_start(uint8_t value);
+		uint8_t read_slow(uint16_t addr);
+		void write_slow(uint16_t addr, uint8_t value);
+		uint8_t read_io(uint16_t addr);
+		void write_io(uint16_t addr, uint8_t value);
 	public:
-		MMU(Cart& cart, GPU& gpu, Input& input);
+		MMU(Scheduler& sched, Cart& cart, GPU& gpu, Input& input, Timer& timer, APU& apu);
 
 		void reset();
-		uint8_t read8(uint16_t addr);
-		void write8(uint16_t addr, uint8_t value);
+		void save(StateWriter &w);
+		void load(StateReader &r);
+		void map();
+		const uint8_t* resolve(uint16_t addr);
+		bool switch_speed();
+		void hblank();
+
+		//Numbered like debuggers and RGBDS .sym files do
+		inline uint16_t bank(uint16_t addr) const {
+			return page_bank[addr >> 12];
+		}
+
+		inline uint8_t read8(uint16_t addr) {
+			const uint8_t *p = read_page[addr >> 12];
+			if(p) return p[addr & 0x0FFF];
+			return read_slow(addr);
+		}
+
+		inline void write8(uint16_t addr, uint8_t value) {
+			uint8_t *p = write_page[addr >> 12];
+			if(p) {
+				p[addr & 0x0FFF] = value;
+				dirty_page[addr >> 12][(addr >> 8) & 0x0F] = 1;
+			}
+			else write_slow(addr, value);
+		}
+
 		uint16_t read16(uint16_t addr);
 		void write16(uint16_t addr, uint16_t value);
 	};
@@ -0,0 +1,147 @@
+#include "movie.h"
+#include "../util.h"
+#include <cstdio>
+#include <cstring>
+
+namespace {
+	void put32(uint8_t *p, uint32_t v) {
+		for(int i=0;i<4;++i) p[i] = (v >> (i*8)) & 0xFF;
+	}
+
+	void put64(uint8_t *p, uint64_t v) {
+		for(int i=0;i<8;++i) p[i] = (v >> (i*8)) & 0xFF;
+	}
+
+	uint32_t get32(const uint8_t *p) {
+		uint32_t v = 0;
+		for(int i=0;i<4;++i) v |= (uint32_t)p[i] << (i*8);
+		return v;
+	}
+
+	uint64_t get64(const uint8_t *p) {
+		uint64_t v = 0;
+		for(int i=0;i<8;++i) v |= (uint64_t)p[i] << (i*8);
+		return v;
+	}
+
+	const size_t header_size = 4 + 4 + 8 + 4 + 4;
+	const size_t run_size = 5;
+}
+
+GB::Movie::Movie() {
+	clear();
+}
+
+void GB::Movie::clear() {
+	rom_hash = 0;
+	start = START_POWER_ON;
+	runs.clear();
+}
+
+void GB::Movie::append(uint8_t buttons) {
+	if(!runs.empty() && runs.back().buttons == buttons && runs.back().frames != UINT32_MAX) {
+		++runs.back().frames;
+		return;
+	}
+	Run r;
+	r.buttons = buttons;
+	r.frames = 1;
+	runs.push_back(r);
+}
+
+uint64_t GB::Movie::frames() const {
+	uint64_t total = 0;
+	for(size_t i=0;i<runs.size();++i) {
+		total += runs[i].frames;
+	}
+	return total;
+}
+
+bool GB::Movie::save(const char *filename) const {
+	FILE *fp = fopen(filename, "wb");
+	if(!fp) return false;
+
+	uint8_t h[header_size];
+	memcpy(h, "GBMV", 4);
+	put32(h + 4, version);
+	put64(h + 8, rom_hash);
+	put32(h + 16, start);
+	put32(h + 20, runs.size());
+	bool ok = fwrite(h, 1, sizeof(h), fp) == sizeof(h);
+
+	for(size_t i=0;i<runs.size() && ok;++i) {
+		uint8_t r[run_size];
+		r[0] = runs[i].buttons;
+		put32(r + 1, runs[i].frames);
+		ok = fwrite(r, 1, sizeof(r), fp) == sizeof(r);
+	}
+	fclose(fp);
+	return ok;
+}
+
+bool GB::Movie::load(const char *filename) {
+	clear();
+	FILE *fp = fopen(filename, "rb");
+	if(!fp) return false;
+
+	uint8_t h[header_size];
+	bool ok = fread(h, 1, sizeof(h), fp) == sizeof(h)
+		&& memcmp(h, "GBMV", 4) == 0
+		&& get32(h + 4) == version;
+	if(ok) {
+		rom_hash = get64(h + 8);
+		start = get32(h + 16);
+		const uint32_t count = get32(h + 20);
+		//A corrupt count must not allocate more runs than the file holds
+		fseek(fp, 0, SEEK_END);
+		const long size = ftell(fp);
+		fseek(fp, header_size, SEEK_SET);
+		ok = size >= (long)header_size && count <= (size - header_size) / run_size;
+		if(ok) runs.resize(count);
+		for(uint32_t i=0;i<count && ok;++i) {
+			uint8_t r[run_size];
+			ok = fread(r, 1, sizeof(r), fp) == sizeof(r);
+			runs[i].buttons = r[0];
+			runs[i].frames = get32(r + 1);
+		}
+	}
+	fclose(fp);
+	if(!ok) clear();
+	return ok;
+}
+
+uint64_t GB::Movie::hash(const void *data, size_t size, uint64_t h) {
+	return fnv1a(data, size, h);
+}
+
+GB::MovieRecorder::MovieRecorder(Movie &movie, InputSource *live) : movie(movie), live(live) {
+}
+
+uint8_t GB::MovieRecorder::poll() {
+	const uint8_t buttons = live ? live->poll() : 0;
+	movie.append(buttons);
+	return buttons;
+}
+
+GB::MoviePlayer::MoviePlayer(const Movie &movie) : movie(movie) {
+	rewind();
+}
+
+void GB::MoviePlayer::rewind() {
+	run = 0;
+	offset = 0;
+}
+
+bool GB::MoviePlayer::done() const {
+	return run >= movie.runs.size();
+}
+
+uint8_t GB::MoviePlayer::poll() {
+	if(done()) return 0;
+	const uint8_t buttons = movie.runs[run].buttons;
+	if(++offset >= movie.runs[run].frames) {
+		++run;
+		offset = 0;
+	}
+	return buttons;
+}
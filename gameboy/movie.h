@@ -0,0 +1,59 @@
+#pragma once
+#include "input.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace GB {
+
+	//Per-frame button state, run-length encoded, tied to one ROM and start state.
+	//Little endian on disk: "GBMV", version, rom hash, start, run count, runs.
+	struct Movie {
+		enum {
+			version = 1
+		};
+		enum Start {
+			START_POWER_ON = 0
+		};
+
+		struct Run {
+			uint8_t buttons;
+			uint32_t frames;
+		};
+
+		uint64_t rom_hash;
+		uint8_t start;
+		std::vector<Run> runs;
+	public:
+		Movie();
+
+		void clear();
+		void append(uint8_t buttons);
+		uint64_t frames() const;
+		bool save(const char *filename) const;
+		bool load(const char *filename);
+
+		static uint64_t hash(const void *data, size_t size, uint64_t h = 0xCBF29CE484222325ull);
+	};
+
+	//Passes a live source through and appends everything it returns to a movie
+	struct MovieRecorder : InputSource {
+		Movie &movie;
+		InputSource *live;
+	public:
+		MovieRecorder(Movie &movie, InputSource *live);
+		uint8_t poll();
+	};
+
+	//Plays a movie back, returns no buttons once it has run out
+	struct MoviePlayer : InputSource {
+		const Movie &movie;
+		size_t run;
+		uint32_t offset;
+	public:
+		MoviePlayer(const Movie &movie);
+		void rewind();
+		bool done() const;
+		uint8_t poll();
+	};
+}
@@ -0,0 +1,112 @@
+#include "opcode_stats.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace {
+	//Blocks of all threads that ever counted, kept after a thread exits
+	std::mutex blocks_lock;
+	std::vector<GB::OpcodeStats*> blocks;
+
+	struct Sorted {
+		int index;
+		uint64_t count;
+	};
+
+	//Indices in [from,to) of counts that are not zero, most first
+	std::vector<Sorted> sorted(const uint64_t *counts, int from, int to) {
+		std::vector<Sorted> list;
+		for(int i=from;i<to;++i) {
+			if(counts[i]) list.push_back(Sorted{i, counts[i]});
+		}
+		std::sort(list.begin(), list.end(), [](const Sorted &a, const Sorted &b) { return a.count > b.count; });
+		return list;
+	}
+
+	double percent(uint64_t part, uint64_t whole) {
+		return whole ? part * 100.0 / whole : 0.0;
+	}
+}
+
+thread_local GB::OpcodeStats *GB::OpcodeStats::current = nullptr;
+
+GB::OpcodeStats* GB::OpcodeStats::attach() {
+	OpcodeStats *stats = new OpcodeStats();
+	std::lock_guard<std::mutex> guard(blocks_lock);
+	blocks.push_back(stats);
+	current = stats;
+	return stats;
+}
+
+void GB::OpcodeStats::reset() {
+	std::lock_guard<std::mutex> guard(blocks_lock);
+	for(OpcodeStats *stats : blocks) {
+		memset(stats, 0, sizeof(OpcodeStats));
+	}
+}
+
+//The top opcodes by executions, the CB prefixed ones and the most common pairs
+void GB::OpcodeStats::report(FILE *fp, int top) {
+	if(!enabled) {
+		fprintf(fp, "opcode stats need a build with GBM_OPCODE_STATS\n");
+		return;
+	}
+
+	OpcodeStats *total = new OpcodeStats();
+	{
+		std::lock_guard<std::mutex> guard(blocks_lock);
+		for(OpcodeStats *stats : blocks) {
+			for(int i=0;i<512;++i) {
+				total->executed[i] += stats->executed[i];
+				total->cycles[i] += stats->cycles[i];
+			}
+			for(int i=0;i<256;++i) {
+				total->taken[i] += stats->taken[i];
+			}
+			for(int i=0;i<256*256;++i) {
+				total->pairs[i] += stats->pairs[i];
+			}
+		}
+	}
+
+	//CB prefixed opcodes are also counted as 0xCB, so the totals only use 0x00-0xFF
+	uint64_t instructions = 0, cycles = 0;
+	for(int i=0;i<256;++i) {
+		instructions += total->executed[i];
+		cycles += total->cycles[i];
+	}
+	fprintf(fp, "opcodes: %llu instructions, %llu cycles\n", (unsigned long long)instructions, (unsigned long long)cycles);
+
+	const std::vector<Sorted> primary = sorted(total->executed, 0, 0x100);
+	fprintf(fp, "%-8s %14s %7s %14s %7s %6s %7s\n", "opcode", "executed", "%", "cycles", "%", "avg", "taken");
+	for(size_t i=0;i<primary.size() && int(i)<top;++i) {
+		const int op = primary[i].index;
+		fprintf(fp, "0x%02X     %14llu %6.2f%% %14llu %6.2f%% %6.2f", op,
+			(unsigned long long)total->executed[op], percent(total->executed[op], instructions),
+			(unsigned long long)total->cycles[op], percent(total->cycles[op], cycles),
+			double(total->cycles[op]) / total->executed[op]);
+		if(not_taken_cycles(op)) fprintf(fp, " %6.1f%%", percent(total->taken[op], total->executed[op]));
+		fprintf(fp, "\n");
+	}
+
+	const std::vector<Sorted> extended = sorted(total->executed, 0x100, 0x200);
+	if(!extended.empty()) {
+		fprintf(fp, "%-8s %14s %7s %14s %7s\n", "cb", "executed", "%", "cycles", "%");
+		for(size_t i=0;i<extended.size() && int(i)<top;++i) {
+			const int op = extended[i].index;
+			fprintf(fp, "CB 0x%02X  %14llu %6.2f%% %14llu %6.2f%%\n", op & 0xFF,
+				(unsigned long long)total->executed[op], percent(total->executed[op], instructions),
+				(unsigned long long)total->cycles[op], percent(total->cycles[op], cycles));
+		}
+	}
+
+	const std::vector<Sorted> pairs = sorted(total->pairs, 0, 256*256);
+	fprintf(fp, "%-10s %14s %7s\n", "pair", "executed", "%");
+	for(size_t i=0;i<pairs.size() && int(i)<top/2;++i) {
+		fprintf(fp, "0x%02X 0x%02X  %14llu %6.2f%%\n", pairs[i].index >> 8, pairs[i].index & 0xFF,
+			(unsigned long long)pairs[i].count, percent(pairs[i].count, instructions));
+	}
+
+	delete total;
+}
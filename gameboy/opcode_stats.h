@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+
+namespace GB {
+
+	//Executions and cycles per opcode, counted by Processor::decode when built
+	//with GBM_OPCODE_STATS and compiled out otherwise. Every thread counts into
+	//its own block so parallel instances never share cache lines; report()
+	//adds the blocks up and should only run while the other threads are idle.
+	struct OpcodeStats {
+		uint64_t executed[512];  //0x100 and up are the CB prefixed opcodes
+		uint64_t cycles[512];
+		uint64_t taken[256];     //Conditional branches that were taken
+		uint64_t pairs[256*256]; //Primary opcode followed by primary opcode
+		uint8_t previous;
+
+		static thread_local OpcodeStats *current;
+		static OpcodeStats* attach();
+
+		//Cycles of a conditional branch that is not taken, 0 for anything else
+		static inline int not_taken_cycles(int opcode) {
+			switch(opcode) {
+				case 0x20: case 0x28: case 0x30: case 0x38: return 8;  //JR cc
+				case 0xC0: case 0xC8: case 0xD0: case 0xD8: return 8;  //RET cc
+				case 0xC2: case 0xCA: case 0xD2: case 0xDA: return 12; //JP cc
+				case 0xC4: case 0xCC: case 0xD4: case 0xDC: return 12; //CALL cc
+				default: return 0;
+			}
+		}
+	public:
+#ifdef GBM_OPCODE_STATS
+		static const bool enabled = true;
+#else
+		static const bool enabled = false;
+#endif
+
+		static inline void count(int index, int cycles) {
+			OpcodeStats *stats = current ? current : attach();
+			++stats->executed[index];
+			stats->cycles[index] += cycles;
+			if(index < 0x100) {
+				const int base = not_taken_cycles(index);
+				if(base && cycles > base) ++stats->taken[index];
+				++stats->pairs[(stats->previous << 8) | index];
+				stats->previous = index;
+			}
+		}
+
+		static void report(FILE *fp, int top = 40);
+		static void reset();
+	};
+}
+
+#ifdef GBM_OPCODE_STATS
+#define GBM_COUNT_OPCODE(index, cycles) GB::OpcodeStats::count(index, cycles)
+#else
+#define GBM_COUNT_OPCODE(index, cycles)
+#endif
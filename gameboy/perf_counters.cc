@@ -0,0 +1,183 @@
+#include "perf_counters.h"
+#include <algorithm>
+#include <cstring>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	const char *names[GB::PERF_COUNTERS] = {
+		"cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses",
+	};
+
+#ifdef __linux__
+	struct Event {
+		uint32_t type;
+		uint64_t config;
+	};
+
+	const Event events[GB::PERF_COUNTERS] = {
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+		{PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+	};
+#endif
+}
+
+GB::PerfSample::PerfSample() {
+	clear();
+}
+
+void GB::PerfSample::clear() {
+	memset(counts, 0, sizeof(counts));
+}
+
+void GB::PerfSample::add(const PerfSample &other) {
+	for(int i=0;i<PERF_COUNTERS;++i) {
+		counts[i] += other.counts[i];
+	}
+}
+
+GB::PerfSample GB::PerfSample::since(const PerfSample &start) const {
+	PerfSample delta;
+	for(int i=0;i<PERF_COUNTERS;++i) {
+		delta.counts[i] = counts[i] - start.counts[i];
+	}
+	return delta;
+}
+
+double GB::PerfSample::ipc() const {
+	return counts[PERF_CYCLES] ? double(counts[PERF_INSTRUCTIONS]) / counts[PERF_CYCLES] : 0.0;
+}
+
+//{"cycles": n, ..., "ipc": x} on one line
+void GB::PerfSample::write_json(FILE *fp) const {
+	fprintf(fp, "{");
+	for(int i=0;i<PERF_COUNTERS;++i) {
+		fprintf(fp, "\"%s\": %llu, ", names[i], (unsigned long long)counts[i]);
+	}
+	fprintf(fp, "\"ipc\": %.3f}", ipc());
+}
+
+GB::PerfCounters::PerfCounters() : opened(0) {
+	for(int i=0;i<PERF_COUNTERS;++i) {
+		fds[i] = -1;
+		slots[i] = -1;
+	}
+}
+
+GB::PerfCounters::~PerfCounters() {
+	close();
+}
+
+//Start counting on the calling thread, false when no counter could be opened
+bool GB::PerfCounters::open() {
+	close();
+#ifdef __linux__
+	int leader = -1;
+	for(int i=0;i<PERF_COUNTERS;++i) {
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = events[i].type;
+		attr.config = events[i].config;
+		attr.read_format = PERF_FORMAT_GROUP;
+		attr.disabled = leader < 0;
+		attr.exclude_kernel = 1; //Allowed without privileges
+		attr.exclude_hv = 1;
+		const int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+		if(fd < 0) continue;
+		if(leader < 0) leader = fd;
+		fds[i] = fd;
+		slots[i] = opened++;
+	}
+	if(leader >= 0) {
+		ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	}
+#endif
+	return opened > 0;
+}
+
+void GB::PerfCounters::close() {
+#ifdef __linux__
+	for(int i=PERF_COUNTERS-1;i>=0;--i) { //Members before the leader
+		if(fds[i] >= 0) ::close(fds[i]);
+	}
+#endif
+	for(int i=0;i<PERF_COUNTERS;++i) {
+		fds[i] = -1;
+		slots[i] = -1;
+	}
+	opened = 0;
+}
+
+//Running totals since open
+void GB::PerfCounters::read(PerfSample &sample) {
+	if(!opened) return sample.clear();
+#ifdef __linux__
+	uint64_t values[1 + PERF_COUNTERS]; //Count of values, then the values
+	int leader = -1;
+	for(int i=0;i<PERF_COUNTERS && leader < 0;++i) {
+		leader = fds[i];
+	}
+	if(::read(leader, values, sizeof(values)) <= 0) return sample.clear();
+	for(int i=0;i<PERF_COUNTERS;++i) {
+		sample.counts[i] = slots[i] >= 0 && uint64_t(slots[i]) < values[0] ? values[1 + slots[i]] : 0;
+	}
+#endif
+}
+
+const char* GB::PerfCounters::name(int counter) {
+	return names[counter];
+}
+
+GB::PerfStats::PerfStats(size_t samples) : window(samples > 0 ? samples : 1), next(0) {
+	clear();
+}
+
+void GB::PerfStats::clear() {
+	for(Entry &entry : window) {
+		entry.sample.clear();
+		entry.frames = 0;
+	}
+	next = 0;
+	total.clear();
+	frames = 0;
+}
+
+//Counts of frames frames, a runner slice is a few at once
+void GB::PerfStats::add(const PerfSample &sample, uint64_t frames) {
+	window[next] = Entry{sample, frames};
+	next = (next + 1) % window.size();
+	total.add(sample);
+	this->frames += frames;
+}
+
+GB::PerfSample GB::PerfStats::mean() const {
+	PerfSample sum;
+	uint64_t count = 0;
+	for(const Entry &entry : window) {
+		sum.add(entry.sample);
+		count += entry.frames;
+	}
+	for(int i=0;i<PERF_COUNTERS && count;++i) {
+		sum.counts[i] /= count;
+	}
+	return sum;
+}
+
+GB::PerfSample GB::PerfStats::worst() const {
+	PerfSample most;
+	for(const Entry &entry : window) {
+		for(int i=0;i<PERF_COUNTERS && entry.frames;++i) {
+			most.counts[i] = std::max(most.counts[i], entry.sample.counts[i] / entry.frames);
+		}
+	}
+	return most;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+namespace GB {
+
+	enum {
+		PERF_CYCLES,
+		PERF_INSTRUCTIONS,
+		PERF_BRANCH_MISSES,
+		PERF_L1D_MISSES,
+		PERF_LLC_MISSES,
+		PERF_COUNTERS
+	};
+
+	//Host counts of one stretch of execution
+	struct PerfSample {
+		uint64_t counts[PERF_COUNTERS];
+	public:
+		PerfSample();
+
+		void clear();
+		void add(const PerfSample &other);
+		PerfSample since(const PerfSample &start) const;
+		double ipc() const;
+
+		void write_json(FILE *fp) const;
+	};
+
+	//Hardware counters of the calling thread through Linux perf_event_open,
+	//read as one group so every count covers the same stretch. Counters the
+	//host does not have (VMs, perf_event_paranoid) stay 0, on other systems
+	//nothing opens. A read is a system call, so timing something as short as
+	//one line adds noticeably to what it measures.
+	struct PerfCounters {
+		int fds[PERF_COUNTERS];
+		int slots[PERF_COUNTERS]; //Position in a group read, -1 when not open
+		int opened;
+	public:
+		PerfSample ppu; //GPU::render_line, added up while attached to a System
+
+		PerfCounters();
+		~PerfCounters();
+
+		bool open();
+		void close();
+		bool available() const { return opened > 0; }
+		bool has(int counter) const { return slots[counter] >= 0; }
+		void read(PerfSample &sample);
+
+		static const char* name(int counter);
+	};
+
+	//Counts per frame over the most recent samples, and over everything added
+	struct PerfStats {
+		struct Entry {
+			PerfSample sample;
+			uint64_t frames;
+		};
+
+		std::vector<Entry> window;
+		size_t next;
+	public:
+		PerfSample total;
+		uint64_t frames;
+
+		PerfStats(size_t samples = 60);
+
+		void clear();
+		void add(const PerfSample &sample, uint64_t frames = 1);
+		PerfSample mean() const;  //Per frame, over the window
+		PerfSample worst() const; //Per frame, the highest of each counter in the window
+	};
+}
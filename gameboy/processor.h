@@ -1,10 +1,16 @@
 #pragma once
 
 #include "mmu.h"
+#include "guest_profiler.h"
+#include "trace.h"
+#include "debugger.h"
 #include "../util.h"
 
 namespace GB {
 
+	struct StateWriter;
+	struct StateReader;
+
 	struct Processor {
 		struct {
 			union {
@@ -49,14 +55,26 @@ namespace GB {
 
 		bool ime;
 		bool halt;
+		GuestProfiler *profiler; //Gets the calls for its shadow stack when set
+		Trace *trace;            //Records every instruction when set
+		Debugger *debugger;      //Checks breakpoints before every instruction when set
+		bool fusion;             //Runs known loops in bulk, see fusion.cc
+		uint64_t fused;          //Instructions fusion ran, not counted by System::instructions
+		int gpu_stepped;         //Cycles of this step the GPU already ran, fusion steps it itself
 
 		inline void push(uint16_t a) {
 			regs.SP -= 2;
 			mmu.write16(regs.SP, a);
 		}
 
+		//After the return address went on the stack, before the jump
+		inline void profile_call(uint16_t target) {
+			profiler->enter(mmu.bank(target) << 16 | target, mmu.bank(regs.PC) << 16 | regs.PC, regs.SP);
+		}
+
 		inline void call(uint16_t a) {
 			push(regs.PC + 2);
+			if(profiler) profile_call(a);
 			regs.PC = a;
 		}
 
@@ -125,6 +143,7 @@ namespace GB {
 
 		inline void rst(uint8_t a) {
 			push(regs.PC);
+			if(profiler) profile_call(a);
 			regs.PC = a;
 		}
 
@@ -354,13 +373,18 @@ namespace GB {
 			return temp;
 		}
 
+		void record_trace();
 		void handle_interrupts();
 		void handle_interrupt(uint8_t interrupt,uint16_t vector,uint8_t IE,uint8_t IF);
 		int decode();
+		int fuse(uint8_t length);
+		template<uint8_t opcode> int execute(); //In processor_exec.h
 	public:
 		Processor(MMU& mmu);
 
 		void reset();
+		void save(StateWriter &w);
+		void load(StateReader &r);
 		void print();
 		int step();
 	};
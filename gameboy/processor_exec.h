@@ -0,0 +1,917 @@
+#pragma once
+#include "processor.h"
+#include "opcode_stats.h"
+#include <cstdio>
+
+namespace GB {
+	//1 for the opcodes execute implements, the others print invalid opcode and
+	//return 0. The second table is for the byte after 0xCB. gbm_recompile ends
+	//blocks before the others, keep these in step with the cases below.
+	const uint8_t implemented_ops[256] = {
+		1,1,0,1,1,1,1,1,0,1,1,1,1,1,1,0, //0x
+		1,1,1,1,1,1,1,0,1,1,1,1,1,1,1,0, //1x
+		1,1,1,1,1,1,1,1,1,0,1,1,1,1,1,1, //2x
+		1,1,1,0,1,1,1,0,1,0,1,0,1,1,1,0, //3x
+		1,0,0,0,1,0,1,1,0,0,0,0,1,1,1,1, //4x
+		0,0,0,1,1,0,1,1,1,0,0,0,0,1,1,1, //5x
+		1,1,1,0,0,0,0,1,0,1,0,1,0,0,0,1, //6x
+		1,1,1,1,0,0,1,1,1,1,1,1,1,1,1,0, //7x
+		1,1,1,1,0,1,1,1,0,1,0,0,0,0,1,0, //8x
+		1,1,1,0,0,0,1,1,0,0,0,0,0,0,0,0, //9x
+		1,1,0,0,0,0,0,1,0,1,0,0,0,0,0,1, //Ax
+		1,1,1,1,0,0,1,0,1,1,0,0,0,0,1,0, //Bx
+		1,1,1,1,0,1,1,1,1,1,1,1,0,1,0,0, //Cx
+		1,1,0,0,0,1,1,0,1,1,1,0,0,0,0,0, //Dx
+		1,1,1,0,0,1,1,0,0,1,1,0,0,0,1,1, //Ex
+		1,1,0,1,0,1,1,0,0,0,1,1,0,0,1,1, //Fx
+	};
+
+	const uint8_t implemented_cb_ops[256] = {
+		0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, //0x
+		0,0,1,0,0,0,0,0,0,0,0,0,1,1,0,0, //1x
+		0,0,0,1,0,0,0,1,0,0,0,0,0,0,0,0, //2x
+		0,0,0,1,0,0,0,1,0,0,0,0,1,1,0,1, //3x
+		1,1,0,0,0,0,1,1,1,0,0,0,0,0,0,1, //4x
+		1,0,0,0,0,0,0,1,1,0,0,0,0,0,0,1, //5x
+		1,1,0,0,0,0,0,1,1,1,0,0,0,0,0,1, //6x
+		1,1,0,0,0,0,0,1,1,1,0,0,0,0,1,1, //7x
+		0,0,0,0,0,0,1,1,0,0,0,0,0,0,0,0, //8x
+		0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,0, //9x
+		0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, //Ax
+		0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,0, //Bx
+		0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, //Cx
+		0,0,0,0,0,0,0,0,1,0,0,0,0,0,1,0, //Dx
+		0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, //Ex
+		0,0,0,0,0,0,0,0,1,0,0,0,0,0,1,0, //Fx
+	};
+}
+
+//The instruction set, one instantiation per primary opcode so the switch
+//folds away. decode dispatches into it and recompiled blocks inline it, with
+//PC just past the opcode in both cases.
+template<uint8_t opcode> inline int GB::Processor::execute() {
+	int cycles = 0;
+	switch(opcode) {
+		case 0x00: //NOP
+			cycles = 4;
+			break;
+		case 0x01: //LD BC, nn
+			regs.BC = mmu.read16(regs.PC);
+			regs.PC += 2;
+			cycles = 12;
+			break;
+		case 0x03: //INC BC
+			++regs.BC;
+			cycles = 8;
+			break;
+		case 0x04: //INC B
+			regs.B = inc(regs.B);
+			cycles = 4;
+			break;
+		case 0x05: //DEC B
+			regs.B = dec(regs.B);
+			cycles = 4;
+			break;
+		case 0x06: //LD B, n
+			regs.B = mmu.read8(regs.PC++);
+			cycles = 8;
+			break;
+		case 0x07: //RLC A
+			regs.A = rlc(regs.A);
+			regs.F.Z = 0;
+			cycles = 4;
+			break;
+		case 0x09: //ADD HL, BC
+			regs.HL = ADD16(regs.HL, regs.BC);
+			cycles = 8;
+			break;
+		case 0x0A: //LD A, (BC)
+			regs.A = mmu.read8(regs.BC);
+			cycles = 8;
+			break;
+		case 0x0B: //DEC BC
+			--regs.BC;
+			cycles = 8;
+			break;
+		case 0x0C: //INC C
+			regs.C = inc(regs.C);
+			cycles = 4;
+			break;
+		case 0x0D: //DEC C
+			regs.C = dec(regs.C);
+			cycles = 4;
+			break;
+		case 0x0E: //LD C, n
+			regs.C = mmu.read8(regs.PC++);
+			cycles = 8;
+			break;
+		case 0x10: //STOP
+			//TODO low power mode until a button is pressed, only the CGB speed switch is done
+			++regs.PC;
+			mmu.switch_speed();
+			cycles = 4;
+			break;
+		case 0x11: //LD DE, nn
+			regs.DE = mmu.read16(regs.PC);
+			regs.PC += 2;
+			cycles = 12;
+			break;
+		case 0x12: //LD (DE), A
+			mmu.write8(regs.DE, regs.A);
+			cycles = 8;
+			break;
+		case 0x13: //INC DE
+			++regs.DE;
+			cycles = 8;
+			break;
+		case 0x14: //INC D
+			regs.D = inc(regs.D);
+			cycles = 4;
+			break;
+		case 0x15: //DEC D
+			regs.D = dec(regs.D);
+			cycles = 4;
+			break;
+		case 0x16: //LD D, n
+			regs.D = mmu.read8(regs.PC++);
+			cycles = 8;
+			break;
+		case 0x18: //JR n
+			jr(mmu.read8(regs.PC));
+			++regs.PC;
+			cycles = 12;
+			break;
+		case 0x19: //ADD HL, DE
+			regs.HL = ADD16(regs.HL, regs.DE);
+			cycles = 8;
+			break;
+		case 0x1A: //LD A, (DE)
+			regs.A = mmu.read8(regs.DE);
+			cycles = 8;
+			break;
+		case 0x1B: //DEC DE
+			--regs.DE;
+			cycles = 8;
+			break;
+		case 0x1C: //INC E
+			regs.E = inc(regs.E);
+			cycles = 4;
+			break;
+		case 0x1D: //DEC E
+			regs.E = dec(regs.E);
+			cycles = 4;
+			break;
+		case 0x1E: //LD E, n
+			regs.E = mmu.read8(regs.PC++);
+			cycles = 8;
+			break;
+		case 0x20: //JR NZ, n
+			if(regs.F.Z == 0) {
+				const uint8_t offset = mmu.read8(regs.PC);
+				jr(offset);
+				++regs.PC;
+				cycles = 12;
+				if(fusion && offset >= 0xF8 && offset <= 0xFD) cycles += fuse(0x100 - offset); //Loops of 3 to 8 bytes
+			} else {
+				++regs.PC;
+				cycles = 8;
+			}
+			break;
+		case 0x21: //LD HL, nn
+			regs.HL = mmu.read16(regs.PC);
+			regs.PC += 2;
+			cycles = 12;
+			break;
+		case 0x22: //LDI (HL), A
+			mmu.write8(regs.HL++, regs.A);
+			cycles = 8;
+			break;
+		case 0x23: //INC HL
+			++regs.HL;
+			cycles = 8;
+			break;
+		case 0x24: //INC H
+			regs.H = inc(regs.H);
+			cycles = 4;
+			break;
+		case 0x25: //DEC H
+			regs.H = dec(regs.H);
+			cycles = 4;
+			break;
+		case 0x26: //LD H, n
+			regs.H = mmu.read8(regs.PC++);
+			cycles = 8;
+			break;
+		case 0x27: //DAA
+			regs.A = daa(regs.A);
+			cycles = 4;
+			break;
+		case 0x28: //JR Z, n
+			if(regs.F.Z != 0) {
+				jr(mmu.read8(regs.PC));
+				++regs.PC;
+				cycles = 12;
+			} else {
+				++regs.PC;
+				cycles = 8;
+			}
+			break;
+		case 0x2A: //LDI A, (HL)
+			regs.A = mmu.read8(regs.HL++);
+			cycles = 8;
+			break;
+		case 0x2B: //DEC HL
+			--regs.HL;
+			cycles = 8;
+			break;
+		case 0x2C: //INC L
+			regs.L = inc(regs.L);
+			cycles = 4;
+			break;
+		case 0x2D: //DEC L
+			regs.L = dec(regs.L);
+			cycles = 4;
+			break;
+		case 0x2E: //LD L, n
+			regs.L = mmu.read8(regs.PC++);
+			cycles = 8;
+			break;
+		case 0x2F: //CPL
+			regs.A = ~regs.A;
+			regs.F.N = 1;
+			regs.F.H = 1;
+			cycles = 4;
+			break;
+		case 0x30: //JR NC, n
+			if(regs.F.C == 0) {
+				jr(mmu.read8(regs.PC));
+				++regs.PC;
+				cycles = 12;
+			} else {
+				++regs.PC;
+				cycles = 8;
+			}
+			break;
+		case 0x31: //LD SP, nn
+			regs.SP = mmu.read16(regs.PC);
+			regs.PC += 2;
+			cycles = 12;
+			break;
+		case 0x32: //LDD (HL), A
+			mmu.write8(regs.HL--, regs.A);
+			cycles = 8;
+			break;
+		case 0x34: //INC (HL)
+			mmu.write8(regs.HL, inc(mmu.read8(regs.HL)));
+			cycles = 12;
+			break;
+		case 0x35: //DEC (HL)
+			mmu.write8(regs.HL, dec(mmu.read8(regs.HL)));
+			cycles = 12;
+			break;
+		case 0x36: //LD (HL), n
+			mmu.write8(regs.HL, mmu.read8(regs.PC++));
+			cycles = 12;
+			break;
+		case 0x38: //JR C, n
+			if(regs.F.C != 0) {
+				jr(mmu.read8(regs.PC));
+				++regs.PC;
+				cycles = 12;
+			} else {
+				++regs.PC;
+				cycles = 8;
+			}
+			break;
+		case 0x3A: //LDD A, (HL)
+			regs.A = mmu.read8(regs.HL--);
+			cycles = 8;
+			break;
+		case 0x3C: //INC A
+			regs.A = inc(regs.A);
+			cycles = 4;
+			break;
+		case 0x3D: //DEC A
+			regs.A = dec(regs.A);
+			cycles = 4;
+			break;
+		case 0x40: //LD B, B
+			cycles = 4;
+			break;
+		case 0x44: //LD B, H
+			regs.B = regs.H;
+			cycles = 4;
+			break;
+		case 0x46: //LD B, (HL)
+			regs.B = mmu.read8(regs.HL);
+			cycles = 8;
+			break;
+		case 0x47: //LD B, A
+			regs.B = regs.A;
+			cycles = 4;
+			break;
+		case 0x4C: //LD C, H
+			regs.C = regs.H;
+			cycles = 4;
+			break;
+		case 0x4D: //LD C, L
+			regs.C = regs.L;
+			cycles = 4;
+			break;
+		case 0x4E: //LD C, (HL)
+			regs.C = mmu.read8(regs.HL);
+			cycles = 8;
+			break;
+		case 0x4F: //LD C, A
+			regs.C = regs.A;
+			cycles = 4;
+			break;
+		case 0x53: //LD D, E
+			regs.D = regs.E;
+			cycles = 4;
+			break;
+		case 0x54: //LD D, H
+			regs.D = regs.H;
+			cycles = 4;
+			break;
+		case 0x56: //LD D, (HL)
+			regs.D = mmu.read8(regs.HL);
+			cycles = 8;
+			break;
+		case 0x57: //LD D, A
+			regs.D = regs.A;
+			cycles = 4;
+			break;
+		case 0x58: //LD E, B
+			regs.E = regs.B;
+			cycles = 4;
+			break;
+		case 0x5D: //LD E, L
+			regs.E = regs.L;
+			cycles = 4;
+			break;
+		case 0x5F: //LD E, A
+			regs.E = regs.A;
+			cycles = 4;
+			break;
+		case 0x3E: //LD A, n
+			regs.A = mmu.read8(regs.PC++);
+			cycles = 8;
+			break;
+		case 0x5E: //LD E, (HL)
+			regs.E = mmu.read8(regs.HL);
+			cycles = 8;
+			break;
+		case 0x60: //LD H, B
+			regs.H = regs.B;
+			cycles = 4;
+			break;
+		case 0x61: //LD H, C
+			regs.H = regs.C;
+			cycles = 4;
+			break;
+		case 0x62: //LD H, D
+			regs.H = regs.D;
+			cycles = 4;
+			break;
+		case 0x67: //LD H, A
+			regs.H = regs.A;
+			cycles = 4;
+			break;
+		case 0x69: //LD L, C
+			regs.L = regs.C;
+			cycles = 4;
+			break;
+		case 0x6B: //LD L, E
+			regs.L = regs.E;
+			cycles = 4;
+			break;
+		case 0x6F: //LD L, A
+			regs.L = regs.A;
+			cycles = 4;
+			break;
+		case 0x70: //LD (HL), B
+			mmu.write8(regs.HL, regs.B);
+			cycles = 8;
+			break;
+		case 0x71: //LD (HL), C
+			mmu.write8(regs.HL, regs.C);
+			cycles = 8;
+			break;
+		case 0x72: //LD (HL), D
+			mmu.write8(regs.HL, regs.D);
+			cycles = 8;
+			break;
+		case 0x73: //LD (HL), E
+			mmu.write8(regs.HL, regs.E);
+			cycles = 8;
+			break;
+		case 0x76: //HALT
+			//TODO Halt bug
+			if(ime)
+				halt = 1;
+			cycles = 4;
+			break;
+		case 0x77: //LD (HL), A
+			mmu.write8(regs.HL, regs.A);
+			cycles = 8;
+			break;
+		case 0x78: //LD A, B
+			regs.A = regs.B;
+			cycles = 4;
+			break;
+		case 0x79: //LD A, C
+			regs.A = regs.C;
+			cycles = 4;
+			break;
+		case 0x7A: //LD A, D
+			regs.A = regs.D;
+			cycles = 4;
+			break;
+		case 0x7B: //LD A, E
+			regs.A = regs.E;
+			cycles = 4;
+			break;
+		case 0x7C: //LD A, H
+			regs.A = regs.H;
+			cycles = 4;
+			break;
+		case 0x7D: //LD A, L
+			regs.A = regs.L;
+			cycles = 4;
+			break;
+		case 0x7E: //LD A, (HL)
+			regs.A = mmu.read8(regs.HL);
+			cycles = 8;
+			break;
+		case 0x80: //ADD A, B
+			regs.A = ADD(regs.A, regs.B);
+			cycles = 4;
+			break;
+		case 0x81: //ADD A, C
+			regs.A = ADD(regs.A, regs.C);
+			cycles = 4;
+			break;
+		case 0x82: //ADD A, D
+			regs.A = ADD(regs.A, regs.D);
+			cycles = 4;
+			break;
+		case 0x83: //ADD A, E
+			regs.A = ADD(regs.A, regs.E);
+			cycles = 4;
+			break;
+		case 0x85: //ADD A, L
+			regs.A = ADD(regs.A, regs.L);
+			cycles = 4;
+			break;
+		case 0x86: //ADD A, (HL)
+			regs.A = ADD(regs.A, mmu.read8(regs.HL));
+			cycles = 8;
+			break;
+		case 0x87: //ADD A, A
+			regs.A = ADD(regs.A, regs.A);
+			cycles = 4;
+			break;
+		case 0x89: //ADC A, C
+			regs.A = adc(regs.A, regs.C);
+			cycles = 4;
+			break;
+		case 0x8E: //ADC A, (HL)
+			regs.A = adc(regs.A, mmu.read8(regs.HL));
+			cycles = 8;
+			break;
+		case 0x90: //SUB A, B
+			regs.A = sub(regs.A, regs.B);
+			cycles = 4;
+			break;
+		case 0x91: //SUB A, C
+			regs.A = sub(regs.A, regs.C);
+			cycles = 4;
+			break;
+		case 0x92: //SUB A, D
+			regs.A = sub(regs.A, regs.D);
+			cycles = 4;
+			break;
+		case 0x96: //SUB A, (HL)
+			regs.A = sub(regs.A, mmu.read8(regs.HL));
+			cycles = 8;
+			break;
+		case 0x97: //SUB A, A
+			regs.A = sub(regs.A, regs.A);
+			cycles = 4;
+			break;
+		case 0xA0: //AND B
+			regs.A = AND(regs.A, regs.B);
+			cycles = 4;
+			break;
+		case 0xA1: //AND C
+			regs.A = AND(regs.A, regs.C);
+			cycles = 4;
+			break;
+		case 0xA7: //AND A
+			regs.A = AND(regs.A, regs.A);
+			cycles = 4;
+			break;
+		case 0xA9: //XOR C
+			regs.A = XOR(regs.A, regs.C);
+			cycles = 4;
+			break;
+		case 0xAF: //XOR A
+			regs.A = XOR(regs.A, regs.A);
+			cycles = 4;
+			break;
+		case 0xB0: //OR B
+			regs.A = OR(regs.A, regs.B);
+			cycles = 4;
+			break;
+		case 0xB1: //OR C
+			regs.A = OR(regs.A, regs.C);
+			cycles = 4;
+			break;
+		case 0xB2: //OR D
+			regs.A = OR(regs.A, regs.D);
+			cycles = 4;
+			break;
+		case 0xB3: //OR E
+			regs.A = OR(regs.A, regs.E);
+			cycles = 4;
+			break;
+		case 0xB6: //OR (HL)
+			regs.A = OR(regs.A, mmu.read8(regs.HL));
+			cycles = 8;
+			break;
+		case 0xB8: //CP B
+			sub(regs.A, regs.B);
+			cycles = 4;
+			break;
+		case 0xB9: //CP C
+			sub(regs.A, regs.C);
+			cycles = 4;
+			break;
+		case 0xBE: //CP (HL)
+			sub(regs.A, mmu.read8(regs.HL));
+			cycles = 8;
+			break;
+		case 0xC0: //RET NZ
+			if(regs.F.Z == 0) {
+				ret();
+				cycles = 20;
+			} else {
+				cycles = 8;
+			}
+			break;
+		case 0xC1: //POP BC
+			regs.BC = pop();
+			cycles = 12;
+			break;
+		case 0xC2: //JP NZ, nn
+			if(regs.F.Z == 0) {
+				regs.PC = mmu.read16(regs.PC);
+				cycles = 16;
+			} else {
+				regs.PC += 2;
+				cycles = 12;
+			}
+			break;
+		case 0xC3: //JP nn
+			regs.PC = mmu.read16(regs.PC);
+			cycles = 12;
+			break;
+		case 0xC5: //PUSH BC
+			push(regs.BC);
+			cycles = 16;
+			break;
+		case 0xC6: //ADD A, n
+			regs.A = ADD(regs.A, mmu.read8(regs.PC++));
+			cycles = 8;
+			break;
+		case 0xC7: //RST 0x00
+			rst(0x00);
+			cycles = 16;
+			break;
+		case 0xC8: //RET Z
+			if(regs.F.Z != 0) {
+				ret();
+				cycles = 20;
+			} else {
+				cycles = 8;
+			}
+			break;
+		case 0xC9: //RET
+			ret();
+			cycles = 16;
+			break;
+		case 0xCA: //JP Z, nn
+			if(regs.F.Z != 0) {
+				regs.PC = mmu.read16(regs.PC);
+				cycles = 16;
+			} else {
+				regs.PC += 2;
+				cycles = 12;
+			}
+			break;
+		case 0xCB: //extended instruction set
+			{
+				uint8_t opcode2 = mmu.read8(regs.PC++);
+				switch(opcode2) {
+					case 0x12: //RL D
+						regs.D = rl(regs.D);
+						cycles = 8;
+						break;
+					case 0x1C: //RR H
+						regs.H = rr(regs.H);
+						cycles = 8;
+						break;
+					case 0x1D: //RR L
+						regs.L = rr(regs.L);
+						cycles = 8;
+						break;
+					case 0x23: //SLA H
+						regs.H = sla(regs.H);
+						cycles = 8;
+						break;
+					case 0x27: //SLA A
+						regs.A = sla(regs.A);
+						cycles = 8;
+						break;
+					case 0x33: //SWAP E
+						regs.E = swap(regs.E);
+						cycles = 8;
+						break;
+					case 0x37: //SWAP A
+						regs.A = swap(regs.A);
+						cycles = 8;
+						break;
+					case 0x3C: //SRL H
+						regs.H = srl(regs.H);
+						cycles = 8;
+						break;
+					case 0x3D: //SRL L
+						regs.L = srl(regs.L);
+						cycles = 8;
+						break;
+					case 0x3F: //SRL A
+						regs.A = srl(regs.A);
+						cycles = 8;
+						break;
+					case 0x40: //BIT 0, B
+						bit(regs.B, 0);
+						cycles = 8;
+						break;
+					case 0x41: //BIT 0, C
+						bit(regs.C, 0);
+						cycles = 8;
+						break;
+					case 0x46: //BIT 0, (HL)
+						bit(mmu.read8(regs.HL), 0);
+						cycles = 16;
+						break;
+					case 0x47: //BIT 0, A
+						bit(regs.A, 0);
+						cycles = 8;
+						break;
+					case 0x48: //BIT 1, B
+						bit(regs.B, 1);
+						cycles = 8;
+						break;
+					case 0x4F: //BIT 1, A
+						bit(regs.A, 1);
+						cycles = 8;
+						break;
+					case 0x50: //BIT 2, B
+						bit(regs.B, 2);
+						cycles = 8;
+						break;
+					case 0x57: //BIT 2, A
+						bit(regs.A, 2);
+						cycles = 8;
+						break;
+					case 0x58: //BIT 3, B
+						bit(regs.B, 3);
+						cycles = 8;
+						break;
+					case 0x5F: //BIT 3, A
+						bit(regs.A, 3);
+						cycles = 8;
+						break;
+					case 0x60: //BIT 4, B
+						bit(regs.B, 4);
+						cycles = 8;
+						break;
+					case 0x61: //BIT 4, C
+						bit(regs.C, 4);
+						cycles = 8;
+						break;
+					case 0x67: //BIT 4, A
+						bit(regs.A, 4);
+						cycles = 8;
+						break;
+					case 0x68: //BIT 5, B
+						bit(regs.B, 5);
+						cycles = 8;
+						break;
+					case 0x69: //BIT 5, C
+						bit(regs.C, 5);
+						cycles = 8;
+						break;
+					case 0x6F: //BIT 5, A
+						bit(regs.A, 5);
+						cycles = 8;
+						break;
+					case 0x71: //BIT 6, C
+						bit(regs.C, 6);
+						cycles = 8;
+						break;
+					case 0x70: //BIT 6, B
+						bit(regs.B, 6);
+						cycles = 8;
+						break;
+					case 0x77: //BIT 6, A
+						bit(regs.A, 6);
+						cycles = 8;
+						break;
+					case 0x78: //BIT 7, B
+						bit(regs.B, 7);
+						cycles = 8;
+						break;
+					case 0x79: //BIT 7, C
+						bit(regs.C, 7);
+						cycles = 8;
+						break;
+					case 0x7E: //BIT 7, (HL)
+						bit(mmu.read8(regs.HL), 7);
+						cycles = 16;
+						break;
+					case 0x7F: //BIT 7, A
+						bit(regs.A, 7);
+						cycles = 8;
+						break;
+					case 0x86: //RES 0, (HL)
+						mmu.write8(regs.HL, res(mmu.read8(regs.HL), 0));
+						cycles = 16;
+						break;
+					case 0x87: //RES 0,A
+						regs.A = res(regs.A, 0);
+						cycles = 8;
+						break;
+					case 0x9E: //RES 3, (HL)
+						mmu.write8(regs.HL, res(mmu.read8(regs.HL), 3));
+						cycles = 16;
+						break;
+					case 0xBE: //RES 7, (HL)
+						mmu.write8(regs.HL, res(mmu.read8(regs.HL), 7));
+						cycles = 16;
+						break;
+					case 0xD8: //SET 3, B
+						set(regs.B, 3);
+						cycles = 8;
+					case 0xDE: //SET 3, (HL)
+						mmu.write8(regs.HL, set(mmu.read8(regs.HL), 3));
+						cycles = 16;
+						break;
+					case 0xF8: //SET 7, B
+						set(regs.B, 7);
+						cycles = 8;
+					case 0xFE: //SET 7, (HL)
+						mmu.write8(regs.HL, set(mmu.read8(regs.HL), 7));
+						cycles = 16;
+						break;
+					default:
+						printf("invalid opcode 0x%X%X at 0x%X\n",opcode,opcode2,regs.PC-2);
+						cycles = 0;
+						break;
+				}
+				GBM_COUNT_OPCODE(0x100 | opcode2, cycles);
+			}
+			break;
+		case 0xCD: //CALL nn
+			call(mmu.read16(regs.PC));
+			cycles = 24;
+			break;
+		case 0xD0: //RET NC
+			if(regs.F.C == 0) {
+				ret();
+				cycles = 20;
+			} else {
+				cycles = 8;
+			}
+			break;
+		case 0xD1: //POP DE
+			regs.DE = pop();
+			cycles = 12;
+			break;
+		case 0xD5: //PUSH DE
+			push(regs.DE);
+			cycles = 16;
+			break;
+		case 0xD6: //SUB A, n
+			regs.A = sub(regs.A, mmu.read8(regs.PC++));
+			cycles = 8;
+			break;
+		case 0xD8: //RET C
+			if(regs.F.C != 0) {
+				ret();
+				cycles = 20;
+			} else {
+				cycles = 8;
+			}
+			break;
+		case 0xD9: //RETI
+			ret();
+			ime = true;
+			cycles = 16;
+			break;
+		case 0xDA: //JP C, nn
+			if(regs.F.C != 0) {
+				regs.PC = mmu.read16(regs.PC);
+				cycles = 16;
+			} else {
+				regs.PC += 2;
+				cycles = 12;
+			}
+			break;
+		case 0xE0: //LDH (n), A
+			mmu.write8(mmu.read8(regs.PC++) + 0xFF00, regs.A);
+			cycles = 12;
+			break;
+		case 0xE1: //POP HL
+			regs.HL = pop();
+			cycles = 12;
+			break;
+		case 0xE2: //LD (C), A
+			mmu.write8(0xFF00 + regs.C, regs.A);
+			cycles = 8;
+			break;
+		case 0xE5: //PUSH HL
+			push(regs.HL);
+			cycles = 16;
+			break;
+		case 0xE6: //AND n
+			regs.A = AND(regs.A, mmu.read8(regs.PC++));
+			cycles = 8;
+			break;
+		case 0xE9: //JP HL
+			regs.PC = regs.HL;
+			cycles = 4;
+			break;
+		case 0xEA: //LD (nn), A
+			mmu.write8(mmu.read16(regs.PC), regs.A);
+			regs.PC += 2;
+			cycles = 16;
+			break;
+		case 0xEE: //XOR n
+			regs.A = XOR(regs.A, mmu.read8(regs.PC++));
+			cycles = 8;
+			break;
+		case 0xEF: //RST 0x28
+			rst(0x28);
+			cycles = 16;
+			break;
+		case 0xF0: //LDH A, (n)
+			regs.A = mmu.read8(0xFF00 + mmu.read8(regs.PC++));
+			cycles = 12;
+			break;
+		case 0xF1: //POP AF
+			regs.AF = pop();
+			cycles = 12;
+			break;
+		case 0xF3: //DI
+			//TODO docs say this should be only in affect from after the next instruction on
+			ime = 0;
+			cycles = 4;
+			break;
+		case 0xF5: //PUSH AF
+			push(regs.AF);
+			cycles = 16;
+			break;
+		case 0xF6: //OR n
+			regs.A = OR(regs.A, mmu.read8(regs.PC++));
+			cycles = 8;
+			break;
+		case 0xFA: //LD A, (nn)
+			regs.A = mmu.read8(mmu.read16(regs.PC));
+			regs.PC += 2;
+			cycles = 16;
+			break;
+		case 0xFB: //EI
+			//TODO docs say this should be only in affect from after the next instruction on
+			ime = 1;
+			cycles = 4;
+			break;
+		case 0xFE: //CP n
+			sub(regs.A, mmu.read8(regs.PC++));
+			cycles = 8;
+			break;
+		case 0xFF: //RST 0x38
+			rst(0x38);
+			cycles = 16;
+			break;
+		default:
+			printf("invalid opcode 0x%X at 0x%X\n",opcode,regs.PC-1);
+			cycles = 0;
+			break;
+	}
+
+	GBM_COUNT_OPCODE(opcode, cycles);
+	return cycles;
+}
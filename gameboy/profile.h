@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <chrono>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace GB {
+
+	//Cheap timestamp for accounting time to components. The unit is whatever
+	//the host counter uses; compare against a wall clock to convert.
+	inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+	}
+
+	//Time spent in components, only collected while a Profile is attached.
+	//The MMU fast path is inlined into the cpu and counts as cpu time, mmu is
+	//the slow path (MMIO, banking, DMA).
+	struct Profile {
+		uint64_t mmu;
+		uint64_t ppu;
+	public:
+		Profile() : mmu(0), ppu(0) {}
+	};
+}
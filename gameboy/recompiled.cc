@@ -0,0 +1,96 @@
+#include "recompiled.h"
+#include "system.h"
+#include "opcode_stats.h"
+#include <cstdio>
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
+GB::Recompiled::Recompiled() : handle(nullptr), blocks(0), logging(false) {
+}
+
+GB::Recompiled::~Recompiled() {
+	unload();
+}
+
+//Load a plugin built for the rom with rom_hash, error says why not
+bool GB::Recompiled::load(const char *file, uint64_t rom_hash, std::string &error) {
+	unload();
+#ifdef _WIN32
+	error = "plugins need dlopen";
+	return false;
+#else
+	handle = dlopen(file, RTLD_NOW | RTLD_LOCAL);
+	if(!handle) {
+		error = dlerror();
+		return false;
+	}
+	const RecompiledRom *rom = static_cast<const RecompiledRom*>(dlsym(handle, "gbm_recompiled"));
+	if(!rom) error = "no gbm_recompiled in plugin";
+	else if(rom->version != version || rom->system_size != sizeof(System)) error = "plugin was built from another gbm";
+	else if(rom->rom_hash != rom_hash) error = "plugin was built for another rom";
+	if(!error.empty()) {
+		unload();
+		return false;
+	}
+	for(size_t i=0;i<rom->count;++i) {
+		const RecompiledBlock &block = rom->blocks[i];
+		const size_t key = block.bank << 1 | block.addr >> 14;
+		if(block.addr >= 0x8000) continue;
+		if(key >= table.size()) table.resize(key + 1);
+		if(table[key].empty()) table[key].resize(0x4000, nullptr);
+		table[key][block.addr & 0x3FFF] = &block;
+	}
+	blocks = rom->count;
+	return true;
+#endif
+}
+
+void GB::Recompiled::unload() {
+	table.clear();
+	blocks = 0;
+#ifndef _WIN32
+	if(handle) dlclose(handle);
+#endif
+	handle = nullptr;
+}
+
+//The block at PC, 0 when decode has to step instead. Interrupts that are due
+//are left to Processor::step, a block starts at the vector after that.
+int GB::Recompiled::run(System &system) {
+	Processor &proc = system.proc;
+	MMU &mmu = system.mmu;
+	const uint16_t pc = proc.regs.PC;
+	if(pc >= 0x8000 || proc.halt || proc.trace || proc.debugger || proc.profiler || mmu.stats || OpcodeStats::enabled) return 0;
+	if(proc.ime && (mmu.IF & mmu.zram[0x7F] & 0x1F)) return 0;
+	const uint16_t bank = mmu.bank(pc);
+	const size_t key = bank << 1 | pc >> 14;
+	const RecompiledBlock *block = key < table.size() && !table[key].empty() ? table[key][pc & 0x3FFF] : nullptr;
+	if(!block) {
+		if(logging) {
+			if(system.block_jumped) {
+				std::lock_guard<std::mutex> guard(lock);
+				misses.insert(uint32_t(bank) << 16 | pc);
+			}
+			system.block_jumped = false;
+		}
+		return 0;
+	}
+	const int cycles = block->run(system);
+	if(logging) { //Not when it left early for the frame or an interrupt, PC is halfway the block then
+		const bool entry = block->jumps || mmu.bank(pc) != bank; //Or a store switched banks under it
+		system.block_jumped = entry && !system.gpu.frame_done && !(proc.ime && (mmu.IF & mmu.zram[0x7F] & 0x1F));
+	}
+	return cycles;
+}
+
+//One bank:addr per line, the --seeds format of gbm_recompile
+bool GB::Recompiled::write_misses(const char *file) const {
+	FILE *fp = fopen(file, "w");
+	if(!fp) return false;
+	std::lock_guard<std::mutex> guard(lock);
+	for(uint32_t miss : misses) {
+		fprintf(fp, "%02X:%04X\n", miss >> 16, miss & 0xFFFF);
+	}
+	return fclose(fp) == 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace GB {
+
+	struct System;
+
+	//Runs one basic block from the current PC, returns its cycles
+	typedef int (*BlockFn)(System &system);
+
+	struct RecompiledBlock {
+		uint16_t bank;
+		uint16_t addr;
+		bool jumps; //Ends in a jump or call, so a PC without a block after it is a missed entry
+		BlockFn run;
+	};
+
+	//What a plugin exports as gbm_recompiled
+	struct RecompiledRom {
+		uint32_t version;     //Recompiled::version of the tree it was generated for
+		uint32_t system_size; //sizeof(System) when it was built, the blocks inline its layout
+		uint64_t rom_hash;
+		size_t count;
+		const RecompiledBlock *blocks;
+	};
+
+	//Blocks of one rom, generated ahead of time by tools/gbm_recompile and
+	//built into a plugin that is loaded with dlopen, so nothing is generated
+	//at run time. System::step runs the block at PC in place of decode. Code
+	//outside the rom, blocks the tool never found and any system with a
+	//trace, debugger, profiler or AccessStats attached take the interpreter.
+	//
+	//Targets of jumps and calls out of blocks that had no block can be logged
+	//and fed back to the tool as seeds, that is how jump tables and banked
+	//calls get found. One Recompiled serves any number of systems on any
+	//number of threads, logging or not.
+	struct Recompiled {
+		void *handle;
+		std::vector<std::vector<const RecompiledBlock*>> table; //By bank << 1 | addr >> 14, then addr & 0x3FFF
+		size_t blocks;
+		bool logging;
+		mutable std::mutex lock; //For misses
+		std::set<uint32_t> misses; //bank << 16 | addr
+	public:
+		static const uint32_t version = 1;
+
+		Recompiled();
+		~Recompiled();
+
+		bool load(const char *file, uint64_t rom_hash, std::string &error);
+		void unload();
+		size_t size() const { return blocks; }
+
+		int run(System &system);
+
+		void log_misses(bool on) { logging = on; }
+		bool write_misses(const char *file) const;
+	};
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "system.h"
+#include "processor_exec.h"
+#include "recompiled.h"
+
+//Included by generated code only. Every instruction of a block goes through
+//step, which does what Processor::step and System::step do around decode.
+namespace GB {
+	namespace Block {
+
+		//True when the block has to give control back: the frame is done or
+		//an interrupt is due
+		template<uint8_t opcode> inline bool step(System &s, int &total) {
+			s.proc.gpu_stepped = 0;
+			int cycles = s.proc.execute<opcode>();
+			if(s.mmu.stall) {
+				cycles += s.mmu.stall;
+				s.mmu.stall = 0;
+			}
+			++s.instructions;
+			s.gpu.step((cycles - s.proc.gpu_stepped) >> s.sched.speed);
+			s.sched.advance(cycles);
+			total += cycles;
+			return s.gpu.frame_done || (s.proc.ime && (s.mmu.IF & s.mmu.zram[0x7F] & 0x1F));
+		}
+
+		//After a store from a block in 0x4000-0x7FFF, which may have switched banks
+		inline bool switched(System &s, uint16_t bank) {
+			return s.mmu.page_bank[0x4] != bank;
+		}
+	}
+}
@@ -0,0 +1,185 @@
+#include "rewind.h"
+#include "system.h"
+#include "timeline.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+	inline uint8_t* put_varint(uint8_t *out, size_t value) {
+		while(value >= 0x80) {
+			*out++ = (value & 0x7F) | 0x80;
+			value >>= 7;
+		}
+		*out++ = value;
+		return out;
+	}
+
+	inline size_t get_varint(const uint8_t *&in) {
+		size_t value = 0;
+		int shift = 0;
+		while(*in & 0x80) {
+			value |= size_t(*in++ & 0x7F) << shift;
+			shift += 7;
+		}
+		value |= size_t(*in++) << shift;
+		return value;
+	}
+
+	inline uint64_t load64(const uint8_t *p) {
+		uint64_t value;
+		memcpy(&value, p, 8);
+		return value;
+	}
+}
+
+GB::Rewind::Rewind(System &system, size_t capacity, size_t max_frames) : system(system), arena(capacity), max_frames(max_frames) {
+	clear();
+}
+
+//Forget all history, also picks up a new layout after a ROM is loaded
+void GB::Rewind::clear() {
+	std::vector<StateRegion> regions;
+	system.state_regions(regions);
+	const size_t size = system.state_size();
+
+	spans.clear();
+	size_t offset = 0;
+	for(const StateRegion &region : regions) {
+		if(region.offset > offset) spans.push_back(Span{offset, region.offset - offset, nullptr});
+		spans.push_back(Span{region.offset, region.size, region.dirty});
+		offset = region.offset + region.size;
+	}
+	if(size > offset) spans.push_back(Span{offset, size - offset, nullptr});
+
+	prev.assign(size, 0);
+	cur.assign(size, 0);
+	scratch.resize(2*size + 64); //Worst case is a literal for every few bytes
+	primed = false;
+	entries.clear();
+	head = 0;
+}
+
+size_t GB::Rewind::bytes() const {
+	size_t total = 0;
+	for(const Entry &entry : entries) {
+		total += entry.size;
+	}
+	return total;
+}
+
+//Emit (skip, length, xor bytes) runs for the differences in [from, to).
+//Equal gaps of a few bytes are folded into a run, a new run costs more.
+uint8_t* GB::Rewind::scan(size_t from, size_t to, size_t &last, uint8_t *out) {
+	const uint8_t *a = cur.data();
+	const uint8_t *b = prev.data();
+	size_t i = from;
+	while(i < to) {
+		while(i + 8 <= to && load64(a + i) == load64(b + i)) i += 8;
+		while(i < to && a[i] == b[i]) ++i;
+		if(i == to) break;
+
+		size_t end = i + 1;
+		for(size_t j = end; j < to && j - end < 4; ++j) {
+			if(a[j] != b[j]) end = j + 1;
+		}
+
+		out = put_varint(out, i - last);
+		out = put_varint(out, end - i);
+		for(size_t j = i; j < end; ++j) {
+			*out++ = a[j] ^ b[j];
+		}
+		last = end;
+		i = end;
+	}
+	return out;
+}
+
+size_t GB::Rewind::encode() {
+	uint8_t *out = scratch.data();
+	size_t last = 0;
+	for(const Span &span : spans) {
+		if(!span.dirty) {
+			out = scan(span.offset, span.offset + span.size, last, out);
+			continue;
+		}
+		//Runs of written blocks, clean blocks are equal to the previous state
+		const size_t blocks = (span.size + (1 << DIRTY_SHIFT) - 1) >> DIRTY_SHIFT;
+		for(size_t i = 0; i < blocks; ) {
+			if(!span.dirty[i]) {
+				++i;
+				continue;
+			}
+			size_t j = i;
+			while(j < blocks && span.dirty[j]) span.dirty[j++] = 0;
+			const size_t from = span.offset + (i << DIRTY_SHIFT);
+			const size_t to = std::min(span.offset + (j << DIRTY_SHIFT), span.offset + span.size);
+			out = scan(from, to, last, out);
+			i = j;
+		}
+	}
+	return out - scratch.data();
+}
+
+//XOR works both ways, applying a delta to a state gives the other one
+void GB::Rewind::apply(const uint8_t *delta, size_t size) {
+	const uint8_t *in = delta;
+	const uint8_t *end = delta + size;
+	uint8_t *state = prev.data();
+	size_t pos = 0;
+	while(in < end) {
+		pos += get_varint(in);
+		const size_t length = get_varint(in);
+		for(size_t i = 0; i < length; ++i) {
+			state[pos + i] ^= in[i];
+		}
+		in += length;
+		pos += length;
+	}
+}
+
+void GB::Rewind::store(const uint8_t *delta, size_t size) {
+	if(size > arena.size()) { //History before this frame can not be reached anymore
+		entries.clear();
+		head = 0;
+		return;
+	}
+	if(head + size > arena.size()) { //Wrap, the entries past head are the oldest
+		while(!entries.empty() && entries.front().start >= head) entries.pop_front();
+		head = 0;
+	}
+	while(!entries.empty() && entries.front().start >= head && entries.front().start < head + size) {
+		entries.pop_front();
+	}
+	if(entries.size() >= max_frames) entries.pop_front();
+
+	memcpy(arena.data() + head, delta, size);
+	entries.push_back(Entry{head, size});
+	head += size;
+}
+
+//Call after every frame
+void GB::Rewind::capture() {
+	TimelineScope scope(PHASE_REWIND);
+	system.save_state(cur.data());
+	if(primed) {
+		const size_t size = encode();
+		store(scratch.data(), size);
+	} else {
+		for(const Span &span : spans) { //The next delta is against this state
+			if(span.dirty) memset(span.dirty, 0, (span.size + (1 << DIRTY_SHIFT) - 1) >> DIRTY_SHIFT);
+		}
+		primed = true;
+	}
+	std::swap(prev, cur);
+}
+
+//Go back to the state captured before the newest one
+bool GB::Rewind::step_back() {
+	TimelineScope scope(PHASE_REWIND);
+	if(entries.empty()) return false;
+	const Entry entry = entries.back();
+	entries.pop_back();
+	apply(arena.data() + entry.start, entry.size);
+	head = entry.start;
+	return system.load_state(prev.data(), prev.size());
+}
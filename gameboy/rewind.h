@@ -0,0 +1,55 @@
+#pragma once
+#include "state.h"
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+namespace GB {
+
+	struct System;
+
+	//Keeps the last frames of play so they can be stepped back through.
+	//Only the newest state is kept whole, every older one is stored as the
+	//run length coded XOR against its successor, so stepping back is applying
+	//the newest delta to the newest state. Memories flag the blocks written to
+	//since the last capture and clean blocks are not even looked at.
+	struct Rewind {
+		struct Entry {
+			size_t start;
+			size_t size;
+		};
+		struct Span {
+			size_t offset;
+			size_t size;
+			uint8_t *dirty; //nullptr is always compared
+		};
+
+		System &system;
+		std::vector<uint8_t> prev;    //Newest state
+		std::vector<uint8_t> cur;     //Scratch for the state being captured
+		std::vector<uint8_t> scratch; //Scratch for the delta being encoded
+		std::vector<Span> spans;
+		bool primed;
+
+		//Deltas live back to back in one ring, the oldest is dropped for room
+		std::vector<uint8_t> arena;
+		std::deque<Entry> entries;
+		size_t head;
+		size_t max_frames;
+
+		uint8_t* scan(size_t from, size_t to, size_t &last, uint8_t *out);
+		size_t encode();
+		void apply(const uint8_t *delta, size_t size);
+		void store(const uint8_t *delta, size_t size);
+	public:
+		Rewind(System &system, size_t capacity, size_t max_frames);
+
+		void clear();
+		void capture();
+		bool step_back();
+
+		size_t frames() const { return entries.size(); }
+		size_t bytes() const;
+	};
+}
@@ -0,0 +1,85 @@
+#include "run_ahead.h"
+#include "system.h"
+
+//Passing a rom loads it into a second instance to run ahead on
+GB::RunAhead::RunAhead(System &system, int frames, const char *rom) : system(system), shadow(nullptr), frames(frames) {
+	hold.buttons = 0;
+	if(rom) {
+		shadow = new System();
+		shadow->load(rom);
+		shadow->input.source = &hold;
+	}
+}
+
+GB::RunAhead::~RunAhead() {
+	delete shadow;
+}
+
+//Only the last frame ahead is drawn, sound is off for all of them. They are
+//rolled back or thrown away, so breakpoints and watches do not stop them.
+int GB::RunAhead::run_ahead(System &target) {
+	AudioRing *ring = target.apu.ring;
+	WavWriter *wav = target.apu.wav;
+	InputSource *source = target.input.source;
+	target.apu.ring = nullptr;
+	target.apu.wav = nullptr;
+	target.input.source = &hold;
+	Debugger *debugger = target.proc.debugger;
+	if(debugger) debugger->suspended = true;
+
+	int cycles = 0;
+	for(int i=0;i<frames;++i) {
+		target.gpu.skip_render = i < frames-1;
+		cycles = target.run_frame();
+		if(cycles == 0) break;
+	}
+	target.gpu.skip_render = false;
+	if(debugger) debugger->suspended = false;
+
+	target.apu.ring = ring;
+	target.apu.wav = wav;
+	target.input.source = source;
+	return cycles;
+}
+
+//Returns the cycles of the real frame, 0 on an invalid opcode
+int GB::RunAhead::run_frame() {
+	if(frames <= 0) return system.run_frame();
+
+	system.gpu.skip_render = true; //Nobody sees the real frame
+	const int cycles = system.run_frame();
+	system.gpu.skip_render = false;
+	if(cycles == 0) return 0;
+
+	hold.buttons = system.input.buttons;
+	state.resize(system.state_size());
+	system.save_state(state.data());
+
+	if(shadow) {
+		shadow->load_state(state.data(), state.size());
+		run_ahead(*shadow);
+		return cycles;
+	}
+
+	blip[0] = system.apu.blip[0];
+	blip[1] = system.apu.blip[1];
+	frame_start = system.apu.frame_start;
+	run_ahead(system);
+	system.load_state(state.data(), state.size());
+	system.apu.blip[0] = blip[0];
+	system.apu.blip[1] = blip[1];
+	system.apu.frame_start = frame_start;
+	return cycles;
+}
+
+//The real frame runs first and its P1 read ends the read stage. The instance
+//ahead is attached too, so the frame stage sees the picture run-ahead shows.
+void GB::RunAhead::set_latency(Latency *latency) {
+	system.set_latency(latency);
+	if(shadow) shadow->set_latency(latency);
+}
+
+//The GPU holding the picture to present
+GB::GPU& GB::RunAhead::screen() {
+	return (shadow && frames > 0) ? shadow->gpu : system.gpu;
+}
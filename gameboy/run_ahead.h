@@ -0,0 +1,44 @@
+#pragma once
+#include "blip.h"
+#include "input.h"
+#include <cstdint>
+#include <vector>
+
+namespace GB {
+
+	struct System;
+	struct GPU;
+	struct Latency;
+
+	//Hides the latency games add between reading the joypad and showing the
+	//result. Every host frame runs one real frame, then runs frames ahead with
+	//the same input and shows the last one; the real state is what continues.
+	//Ahead frames run either on the system itself, which is saved and restored
+	//around them, or on a second instance that gets a copy of the state.
+	struct RunAhead {
+		//Repeats the input latched for the real frame
+		struct Hold : InputSource {
+			uint8_t buttons;
+			uint8_t poll() { return buttons; }
+		};
+
+		System &system;
+		System *shadow; //Second instance, nullptr runs ahead on system
+		Hold hold;
+		std::vector<uint8_t> state;
+		int frames;
+
+		//Audio output is not part of a state, it is kept across the restore
+		Blip blip[2];
+		uint64_t frame_start;
+
+		int run_ahead(System &target);
+	public:
+		RunAhead(System &system, int frames, const char *rom = nullptr);
+		~RunAhead();
+
+		int run_frame();
+		GPU& screen();
+		void set_latency(Latency *latency);
+	};
+}
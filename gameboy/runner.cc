@@ -0,0 +1,135 @@
+#include "runner.h"
+#include "system.h"
+#include <chrono>
+
+namespace {
+	//Counters of the calling worker, opened the first time it runs a slice
+	GB::PerfCounters* worker_counters() {
+		static thread_local GB::PerfCounters counters;
+		static thread_local bool opened = false;
+		if(!opened) {
+			counters.open();
+			opened = true;
+		}
+		return &counters;
+	}
+}
+
+GB::Runner::Runner(int threads, bool pin, int slice) : pool(threads, pin), slice(slice > 0 ? slice : 1) {
+	total_frames = 0;
+	wall_seconds = 0;
+	perf = false;
+}
+
+GB::Runner::~Runner() {
+	for(Instance *instance : instances) {
+		delete instance->system;
+		delete instance;
+	}
+}
+
+//Instances are created on their home worker, spread round robin. The rom is
+//loaded once, the other instances share it.
+void GB::Runner::add(const char *rom, int count) {
+	System *first = nullptr;
+	for(int i=0;i<count;++i) {
+		Instance *instance = new Instance();
+		instance->home = instances.size() % pool.size();
+		instance->system = nullptr;
+		instance->remaining = 0;
+		instance->halted = false;
+		instance->frames = 0;
+		instance->cycles = 0;
+		instance->seconds = 0;
+		instances.push_back(instance);
+
+		if(!first) {
+			pool.submit(instance->home, [instance, rom] {
+				instance->system = new System();
+				instance->system->load(rom);
+			});
+			pool.wait();
+			first = instance->system;
+			continue;
+		}
+		pool.submit(instance->home, [instance, first] {
+			instance->system = new System();
+			instance->system->share_rom(*first); //Fresh from reset, like first
+		});
+	}
+	pool.wait();
+}
+
+//With perf set the host counters of the worker are read around the slice,
+//so they count for whichever instance it ran
+void GB::Runner::run_slice(Instance *instance) {
+	PerfCounters *counters = perf ? worker_counters() : nullptr;
+	PerfSample before;
+	if(counters) counters->read(before);
+	const uint64_t frames = instance->frames;
+	auto start = std::chrono::steady_clock::now();
+	for(int i=0;i<slice && instance->remaining > 0;++i) {
+		const int cycles = instance->system->run_frame();
+		if(cycles == 0) {
+			instance->halted = true;
+			instance->remaining = 0;
+			break;
+		}
+		instance->cycles += cycles;
+		++instance->frames;
+		--instance->remaining;
+	}
+	instance->seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if(counters) {
+		PerfSample after;
+		counters->read(after);
+		instance->perf.add(after.since(before), instance->frames - frames);
+	}
+
+	//Requeue on whichever worker ran this slice, it has the instance in cache
+	if(instance->remaining > 0) {
+		pool.submit(ThreadPool::current(), [this, instance] { run_slice(instance); });
+	}
+}
+
+//Run every instance for frames more frames, blocks until all are done
+void GB::Runner::run(uint64_t frames) {
+	uint64_t before = 0;
+	for(Instance *instance : instances) {
+		before += instance->frames;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for(Instance *instance : instances) {
+		if(instance->halted) continue;
+		instance->remaining = frames;
+		pool.submit(instance->home, [this, instance] { run_slice(instance); });
+	}
+	pool.wait();
+	wall_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	uint64_t after = 0;
+	for(Instance *instance : instances) {
+		after += instance->frames;
+	}
+	total_frames += after - before;
+}
+
+//Reset every instance, halted ones run again
+void GB::Runner::reset() {
+	for(Instance *instance : instances) {
+		instance->system->reset();
+		instance->halted = false;
+	}
+}
+
+//Frames per second of emulation time spent on one instance
+double GB::Runner::fps(size_t i) const {
+	const Instance &instance = *instances[i];
+	return instance.seconds > 0 ? instance.frames / instance.seconds : 0;
+}
+
+//Frames per second of all instances together, over wall clock time
+double GB::Runner::total_fps() const {
+	return wall_seconds > 0 ? total_frames / wall_seconds : 0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "thread_pool.h"
+#include "perf_counters.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace GB {
+
+	struct System;
+
+	//Runs many independent systems in one process on a work stealing pool.
+	//Every instance has a home worker that allocates it, so with pinning its
+	//memory is first touched on (and placed next to) the core that runs it.
+	//Work is handed out in slices of a few frames, an instance is only ever
+	//run by one worker at a time but may be stolen between slices.
+	struct Runner {
+		struct Instance {
+			System *system;
+			int home;
+			uint64_t remaining; //Frames left in the current run
+			bool halted;        //Hit an invalid opcode
+			uint64_t frames;
+			uint64_t cycles;
+			double seconds;     //Time spent emulating it
+			PerfStats perf;     //Host events, while Runner::perf is set
+		};
+
+		ThreadPool pool;
+		std::vector<Instance*> instances;
+		int slice;
+		uint64_t total_frames;
+		double wall_seconds;
+		bool perf;
+
+		void run_slice(Instance *instance);
+	public:
+		Runner(int threads, bool pin, int slice = 8);
+		~Runner();
+
+		void add(const char *rom, int count = 1);
+		size_t size() const { return instances.size(); }
+		System& system(size_t i) { return *instances[i]->system; }
+		const Instance& stats(size_t i) const { return *instances[i]; }
+
+		void run(uint64_t frames);
+		void reset();
+
+		double fps(size_t i) const;
+		double total_fps() const;
+	};
+}
@@ -0,0 +1,80 @@
+#include "scheduler.h"
+#include "state.h"
+
+GB::Scheduler::Scheduler() {
+	for(int i=0;i<EVENT_COUNT;++i) {
+		callback[i] = nullptr;
+		ctx[i] = nullptr;
+	}
+	reset();
+}
+
+void GB::Scheduler::reset() {
+	now = 0;
+	speed = 0;
+	speed_base = 0;
+	real_base = 0;
+	for(int i=0;i<EVENT_COUNT;++i) {
+		when[i] = never;
+	}
+	next = never;
+}
+
+//Callbacks belong to the instance and are not part of the state
+void GB::Scheduler::save(StateWriter &w) {
+	w.put(now);
+	w.put(when, sizeof(when));
+	w.put(speed);
+	w.put(speed_base);
+	w.put(real_base);
+}
+
+void GB::Scheduler::load(StateReader &r) {
+	r.get(now);
+	r.get(when, sizeof(when));
+	r.get(speed);
+	r.get(speed_base);
+	r.get(real_base);
+	update_next();
+}
+
+void GB::Scheduler::bind(Event event, Callback cb, void *cb_ctx) {
+	callback[event] = cb;
+	ctx[event] = cb_ctx;
+}
+
+void GB::Scheduler::schedule(Event event, uint64_t at) {
+	when[event] = at;
+	update_next(); //The event may have moved later
+}
+
+void GB::Scheduler::cancel(Event event) {
+	when[event] = never;
+	update_next();
+}
+
+void GB::Scheduler::set_speed(int new_speed) {
+	real_base = real();
+	speed_base = now;
+	speed = new_speed;
+}
+
+void GB::Scheduler::update_next() {
+	next = never;
+	for(int i=0;i<EVENT_COUNT;++i) {
+		if(when[i] < next) next = when[i];
+	}
+}
+
+void GB::Scheduler::run() {
+	while(now >= next) {
+		int event = 0;
+		for(int i=1;i<EVENT_COUNT;++i) {
+			if(when[i] < when[event]) event = i;
+		}
+		uint64_t at = when[event];
+		when[event] = never; //Callback may reschedule itself
+		update_next();
+		if(callback[event]) callback[event](ctx[event], at);
+	}
+}
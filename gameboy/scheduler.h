@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+
+namespace GB {
+
+	struct StateWriter;
+	struct StateReader;
+
+	//One slot per component that wants a callback at a future cycle
+	enum Event {
+		EVENT_TIMER,
+		EVENT_DMA,
+		EVENT_COUNT
+	};
+
+	struct Scheduler {
+		typedef void (*Callback)(void *ctx, uint64_t when);
+
+		uint64_t now;  //Absolute cycle count since power-on
+		uint64_t next; //Earliest pending event, checked once per instruction
+		int speed;     //1 in CGB double speed mode
+		uint64_t speed_base; //Cycle and real time of the last speed switch
+		uint64_t real_base;
+		uint64_t when[EVENT_COUNT];
+		Callback callback[EVENT_COUNT];
+		void *ctx[EVENT_COUNT];
+
+		void update_next();
+		void run();
+	public:
+		static const uint64_t never = UINT64_MAX;
+
+		Scheduler();
+
+		void reset();
+		void save(StateWriter &w);
+		void load(StateReader &r);
+		void bind(Event event, Callback cb, void *cb_ctx);
+		void schedule(Event event, uint64_t at);
+		void cancel(Event event);
+		void set_speed(int speed);
+
+		//Cycles at single speed, the clock that the GPU and APU run on
+		inline uint64_t real() const {
+			return real_base + ((now - speed_base) >> speed);
+		}
+
+		inline void advance(int cycles) {
+			now += cycles;
+			if(now >= next) run();
+		}
+	};
+}
@@ -0,0 +1,70 @@
+#pragma once
+/* Layout of the shared memory a gbm process exposes with --shm, for drivers
+ * in other processes. The mapping starts with a gbm_shm_header, followed by
+ * a button byte per instance and a ring of slot blocks. A slot block holds
+ * one observation per instance, slot_size bytes apart, so a batch is one
+ * contiguous strided buffer.
+ *
+ * Protocol, with request and response used as futex words (not private):
+ *   driver: fill buttons, op and frames; increment request (release); wake it
+ *   server: run it; fill the next slot block; set slot; response = request
+ *           (release); wake it
+ *   driver: wait until response == request (acquire); read slot block 'slot'
+ * Slot blocks are written round robin, so the last 'slots' observations stay
+ * readable without copying them out.
+ */
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GBM_SHM_VERSION 1
+#define GBM_SHM_MAX_RANGES 8
+
+enum {
+	GBM_SHM_NOP = 0,     /* Only observe */
+	GBM_SHM_ADVANCE = 1, /* Latch buttons, run 'frames' frames and observe */
+	GBM_SHM_RESET = 2,
+	GBM_SHM_QUIT = 3
+};
+
+typedef struct {
+	uint16_t addr;
+	uint16_t size;
+} gbm_shm_range;
+
+/* Start of every observation. The framebuffer (160*144 packed 8 bit RGB)
+ * follows at GBM_SHM_FRAMEBUFFER, then the watched ranges back to back. */
+typedef struct {
+	uint64_t frames; /* Frames run since the instance was created */
+	uint64_t cycles;
+	uint32_t halted; /* Hit an invalid opcode */
+	uint32_t reserved;
+} gbm_shm_slot;
+
+#define GBM_SHM_FRAMEBUFFER 32
+
+typedef struct {
+	char magic[4]; /* "GBSH" */
+	uint32_t version;
+	uint32_t instances;
+	uint32_t slots;
+	uint32_t slot_size; /* Stride between instances in a slot block */
+	uint32_t range_count;
+	gbm_shm_range ranges[GBM_SHM_MAX_RANGES];
+	uint64_t buttons_offset; /* From the start of the mapping */
+	uint64_t slots_offset;
+	uint64_t total_size;
+
+	uint32_t request;
+	uint32_t response;
+	uint32_t op;
+	uint32_t frames;
+	uint32_t slot; /* Slot block with the newest observations */
+	uint32_t reserved;
+} gbm_shm_header;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,180 @@
+#include "shm_server.h"
+#include "runner.h"
+#include "system.h"
+#include <cstring>
+#include <climits>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+	//Block while *word is still seen
+	void futex_wait(uint32_t *word, uint32_t seen) {
+		while(__atomic_load_n(word, __ATOMIC_ACQUIRE) == seen) {
+#ifdef __linux__
+			syscall(SYS_futex, word, FUTEX_WAIT, seen, nullptr, nullptr, 0);
+#else
+			std::this_thread::yield();
+#endif
+		}
+	}
+
+	void futex_wake(uint32_t *word) {
+#ifdef __linux__
+		syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+	}
+
+	//Plain memory is copied a page at a time, anything else straight from the
+	//bus, which AccessStats, watches and Latency do not count as guest reads
+	void read_range(GB::System &system, uint16_t addr, uint16_t size, uint8_t *out) {
+		uint32_t at = addr;
+		const uint32_t end = addr + size;
+		while(at < end && at <= 0xFFFF) {
+			const uint32_t page_end = (at | 0x0FFF) + 1;
+			const uint32_t n = (end < page_end ? end : page_end) - at;
+			const uint8_t *p = system.mmu.resolve(at);
+			if(p) {
+				memcpy(out, p, n);
+			} else {
+				for(uint32_t i=0;i<n;++i) {
+					out[i] = system.mmu.read_io(at + i);
+				}
+			}
+			out += n;
+			at += n;
+		}
+	}
+}
+
+GB::ShmServer::ShmServer(Runner &runner) : runner(runner), base(nullptr), size(0), header(nullptr), seen(0) {
+}
+
+GB::ShmServer::~ShmServer() {
+	close();
+}
+
+//Create the mapping /name for all instances of the runner
+bool GB::ShmServer::open(const char *shm_name, int slots, const std::vector<gbm_shm_range> &ranges) {
+	close();
+	if(slots < 1) slots = 1;
+	if(ranges.size() > GBM_SHM_MAX_RANGES) return false;
+
+	size_t observed = GBM_SHM_FRAMEBUFFER + sizeof(runner.system(0).gpu.framebuffer);
+	for(const gbm_shm_range &range : ranges) {
+		observed += range.size;
+	}
+	const size_t slot_size = (observed + 63) & ~size_t(63); //Instances never share a cache line
+	const size_t instances = runner.size();
+	const size_t buttons_offset = (sizeof(gbm_shm_header) + 63) & ~size_t(63);
+	const size_t slots_offset = (buttons_offset + instances + 4095) & ~size_t(4095);
+	size = slots_offset + slots * instances * slot_size;
+
+	name = std::string("/") + shm_name;
+	const int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+	if(fd < 0) return false;
+	if(ftruncate(fd, size) != 0) {
+		::close(fd);
+		shm_unlink(name.c_str());
+		return false;
+	}
+	void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(p == MAP_FAILED) {
+		shm_unlink(name.c_str());
+		return false;
+	}
+	base = static_cast<uint8_t*>(p);
+	header = reinterpret_cast<gbm_shm_header*>(base);
+
+	memcpy(header->magic, "GBSH", 4);
+	header->version = GBM_SHM_VERSION;
+	header->instances = instances;
+	header->slots = slots;
+	header->slot_size = slot_size;
+	header->range_count = ranges.size();
+	for(size_t i=0;i<ranges.size();++i) {
+		header->ranges[i] = ranges[i];
+	}
+	header->buttons_offset = buttons_offset;
+	header->slots_offset = slots_offset;
+	header->total_size = size;
+	header->request = 0;
+	header->response = 0;
+	header->slot = 0;
+	seen = 0;
+
+	observe(0);
+	return true;
+}
+
+void GB::ShmServer::close() {
+	if(!base) return;
+	munmap(base, size);
+	shm_unlink(name.c_str());
+	base = nullptr;
+	header = nullptr;
+}
+
+uint8_t* GB::ShmServer::slot(uint32_t block, size_t instance) {
+	return base + header->slots_offset + (size_t(block) * header->instances + instance) * header->slot_size;
+}
+
+//Every worker writes the observations of the instances it owns
+void GB::ShmServer::observe(uint32_t block) {
+	for(size_t i=0;i<runner.size();++i) {
+		runner.pool.submit(runner.stats(i).home, [this, block, i] {
+			const Runner::Instance &instance = runner.stats(i);
+			uint8_t *out = slot(block, i);
+			gbm_shm_slot info;
+			info.frames = instance.frames;
+			info.cycles = instance.cycles;
+			info.halted = instance.halted;
+			info.reserved = 0;
+			memcpy(out, &info, sizeof(info));
+
+			System &system = *instance.system;
+			memcpy(out + GBM_SHM_FRAMEBUFFER, system.gpu.framebuffer, sizeof(system.gpu.framebuffer));
+			out += GBM_SHM_FRAMEBUFFER + sizeof(system.gpu.framebuffer);
+			for(uint32_t r=0;r<header->range_count;++r) {
+				read_range(system, header->ranges[r].addr, header->ranges[r].size, out);
+				out += header->ranges[r].size;
+			}
+		});
+	}
+	runner.pool.wait();
+}
+
+//Wait for the next request and serve it, false once the driver quits
+bool GB::ShmServer::step() {
+	futex_wait(&header->request, seen);
+	seen = __atomic_load_n(&header->request, __ATOMIC_ACQUIRE);
+
+	const uint32_t op = header->op;
+	const uint8_t *buttons = base + header->buttons_offset;
+	switch(op) {
+		case GBM_SHM_ADVANCE:
+			for(size_t i=0;i<runner.size();++i) {
+				runner.system(i).input.set_buttons(buttons[i]);
+			}
+			runner.run(header->frames);
+			break;
+		case GBM_SHM_RESET:
+			runner.reset();
+			break;
+	}
+
+	if(op != GBM_SHM_QUIT) {
+		const uint32_t block = (header->slot + 1) % header->slots;
+		observe(block);
+		header->slot = block;
+	}
+	__atomic_store_n(&header->response, seen, __ATOMIC_RELEASE);
+	futex_wake(&header->response);
+	return op != GBM_SHM_QUIT;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include "shm.h"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace GB {
+
+	struct Runner;
+
+	//Serves the instances of a runner to a driver in another process through
+	//shared memory, see shm.h. Observations are written straight into the
+	//mapping by the workers that own the instances.
+	struct ShmServer {
+		Runner &runner;
+		std::string name;
+		uint8_t *base;
+		size_t size;
+		gbm_shm_header *header;
+		uint32_t seen; //Last request served
+
+		uint8_t* slot(uint32_t block, size_t instance);
+		void observe(uint32_t block);
+	public:
+		ShmServer(Runner &runner);
+		~ShmServer();
+
+		bool open(const char *name, int slots, const std::vector<gbm_shm_range> &ranges);
+		void close();
+		bool step();
+	};
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+namespace GB {
+
+	//A savestate is a header followed by tagged sections of raw little endian
+	//fields. Components copy their fields in and out with put/get, so saving
+	//and loading are a series of memcpys into one preallocated buffer.
+	enum {
+		STATE_VERSION = 1,
+		STATE_HEADER_SIZE = 24,
+		DIRTY_SHIFT = 8 //Memories track writes in blocks of 256 bytes
+	};
+
+	//Where a dirty tracked memory ends up in the state, see Rewind
+	struct StateRegion {
+		size_t offset;
+		size_t size;
+		uint8_t *dirty; //One flag per block
+	};
+
+	struct StateWriter {
+		uint8_t *buf; //nullptr only measures
+		size_t pos;
+		size_t section;
+		std::vector<StateRegion> *regions; //Collects dirty tracked memories when set
+	public:
+		StateWriter(uint8_t *buf) : buf(buf), pos(0), section(0), regions(nullptr) {}
+
+		inline void put(const void *data, size_t size) {
+			if(buf) memcpy(buf + pos, data, size);
+			pos += size;
+		}
+
+		//A memory whose writes are flagged in dirty, one flag per block
+		inline void put(const void *data, size_t size, uint8_t *dirty) {
+			if(regions && size) regions->push_back(StateRegion{pos, size, dirty});
+			put(data, size);
+		}
+
+		template<typename T>
+		inline void put(const T &value) {
+			put(&value, sizeof(T));
+		}
+
+		inline void begin(const char *tag) {
+			put(tag, 4);
+			section = pos;
+			put<uint32_t>(0);
+		}
+
+		inline void end() {
+			const uint32_t size = pos - section - 4;
+			if(buf) memcpy(buf + section, &size, 4);
+		}
+
+		size_t size() const { return pos; }
+	};
+
+	struct StateReader {
+		const uint8_t *buf;
+		size_t size;
+		size_t pos;
+		size_t section_end;
+		bool ok;
+	public:
+		StateReader(const uint8_t *buf, size_t size) : buf(buf), size(size), pos(0), section_end(size), ok(true) {}
+
+		inline void get(void *data, size_t n) {
+			if(!ok || pos + n > section_end) {
+				ok = false;
+				return;
+			}
+			memcpy(data, buf + pos, n);
+			pos += n;
+		}
+
+		template<typename T>
+		inline void get(T &value) {
+			get(&value, sizeof(T));
+		}
+
+		inline bool begin(const char *tag) {
+			uint32_t section_size = 0;
+			if(ok && pos + 8 <= size && memcmp(buf + pos, tag, 4) == 0) {
+				memcpy(&section_size, buf + pos + 4, 4);
+				pos += 8;
+				section_end = pos + section_size;
+				ok = section_end <= size;
+			} else {
+				ok = false;
+			}
+			return ok;
+		}
+
+		inline bool end() {
+			ok = ok && pos == section_end;
+			section_end = size;
+			return ok;
+		}
+	};
+}
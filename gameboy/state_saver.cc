@@ -0,0 +1,55 @@
+#include "state_saver.h"
+#include "timeline.h"
+#include <cstdio>
+
+GB::StateSaver::StateSaver() : stopping(false) {
+	worker = std::thread(&StateSaver::run, this);
+}
+
+GB::StateSaver::~StateSaver() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	worker.join();
+}
+
+//Copies the state, the caller can reuse its buffer right away
+void GB::StateSaver::write(const char *filename, const uint8_t *data, size_t size) {
+	Job job;
+	job.filename = filename;
+	job.data.assign(data, data + size);
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		jobs.push_back(std::move(job));
+	}
+	wake.notify_all();
+}
+
+//Block until every queued file is on disk
+void GB::StateSaver::flush() {
+	std::unique_lock<std::mutex> guard(lock);
+	wake.wait(guard, [this] { return jobs.empty(); });
+}
+
+void GB::StateSaver::run() {
+	Timeline::name_thread("state saver");
+	std::unique_lock<std::mutex> guard(lock);
+	for(;;) {
+		wake.wait(guard, [this] { return stopping || !jobs.empty(); });
+		if(jobs.empty()) return; //Stopping and drained
+
+		Job &job = jobs.front();
+		guard.unlock();
+		TimelineScope scope(PHASE_STATE_WRITE);
+		FILE *fp = fopen(job.filename.c_str(), "wb");
+		if(!fp || fwrite(job.data.data(), 1, job.data.size(), fp) != job.data.size())
+			fprintf(stderr, "could not write state %s\n", job.filename.c_str());
+		if(fp) fclose(fp);
+		guard.lock();
+
+		jobs.pop_front();
+		wake.notify_all();
+	}
+}
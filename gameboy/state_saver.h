@@ -0,0 +1,34 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace GB {
+
+	//Writes savestate files on a background thread so the emulator never waits on disk
+	struct StateSaver {
+		struct Job {
+			std::string filename;
+			std::vector<uint8_t> data;
+		};
+
+		std::thread worker;
+		std::mutex lock;
+		std::condition_variable wake;
+		std::deque<Job> jobs;
+		bool stopping;
+
+		void run();
+	public:
+		StateSaver();
+		~StateSaver();
+
+		void write(const char *filename, const uint8_t *data, size_t size);
+		void flush();
+	};
+}
@@ -0,0 +1,249 @@
+#include "system.h"
+#include "state.h"
+#include "timeline.h"
+#include "../util.h"
+#include <cstdlib>
+#include <new>
+
+GB::System::System() : gpu(mmu), timer(sched,mmu), apu(sched), mmu(sched,cart,gpu,input,timer,apu), proc(mmu), input(mmu) {
+	rom_hash = 0;
+	instructions = 0;
+	recompiled = nullptr;
+	block_jumped = false;
+	in_frame = false;
+	frame_cycles = 0;
+	stop_cycles = 0;
+	state_bytes = save_state(nullptr);
+}
+
+void* GB::System::operator new(size_t size) {
+	void *p = nullptr;
+	if(posix_memalign(&p, 4096, size) != 0) throw std::bad_alloc();
+	return p;
+}
+
+void GB::System::operator delete(void *p) {
+	free(p);
+}
+
+void GB::System::reset() {
+	sched.reset();
+	gpu.reset();
+	timer.reset();
+	apu.reset();
+	mmu.reset(); //Picks up DMG/CGB mode from the cart
+	proc.reset();
+	input.reset();
+	in_frame = false;
+	stop_cycles = 0;
+}
+
+void GB::System::load(const char* filename) {
+	cart.load(filename);
+	loaded();
+}
+
+//Copies the rom, returns false if it is too small to be one
+bool GB::System::load(const uint8_t *data, size_t size) {
+	if(!cart.load(data, size)) return false;
+	loaded();
+	return true;
+}
+
+void GB::System::loaded() {
+	rom_hash = fnv1a(cart.rom, cart.rom_size);
+	reset();
+	state_bytes = save_state(nullptr);
+}
+
+//Collect component times into profile, nullptr stops
+void GB::System::set_profile(Profile *profile) {
+	mmu.profile = profile;
+	gpu.profile = profile;
+}
+
+//Sample the guest pc into profiler, nullptr stops
+void GB::System::set_guest_profiler(GuestProfiler *profiler) {
+	proc.profiler = profiler;
+}
+
+//Record every instruction into trace, nullptr stops
+void GB::System::set_trace(Trace *trace) {
+	proc.trace = trace;
+}
+
+//Count guest memory accesses into stats, nullptr stops
+void GB::System::set_access_stats(AccessStats *stats) {
+	mmu.stats = stats;
+	mmu.map();
+}
+
+//Count host events of line rendering into perf, nullptr stops. The counters
+//have to be opened on the thread that runs the system.
+void GB::System::set_perf(PerfCounters *perf) {
+	gpu.perf = perf;
+}
+
+//Report P1 reads to latency, nullptr stops
+void GB::System::set_latency(Latency *latency) {
+	input.latency = latency;
+}
+
+//Run the blocks of a plugin loaded for this rom, nullptr stops
+void GB::System::set_recompiled(Recompiled *recompiled) {
+	this->recompiled = recompiled;
+	block_jumped = false;
+}
+
+//Run the same rom as other without loading it again, starts from reset
+void GB::System::share_rom(const System &other) {
+	cart.share(other.cart);
+	rom_hash = other.rom_hash;
+	reset();
+	state_bytes = save_state(nullptr);
+}
+
+//Become a copy of other, including the picture on screen. Input sources and
+//audio sinks are not copied, they belong to whoever drives a system.
+void GB::System::copy(System &other) {
+	if(cart.rom != other.cart.rom) share_rom(other);
+	scratch.resize(state_bytes);
+	other.save_state(scratch.data());
+	load_state(scratch.data(), scratch.size());
+	memcpy(gpu.framebuffer, other.gpu.framebuffer, sizeof(gpu.framebuffer));
+}
+
+GB::System* GB::System::clone() {
+	System *system = new System();
+	system->copy(*this);
+	return system;
+}
+
+//Emulate one instruction, or one recompiled block, returns the cycles it took or
+//0 on an invalid opcode or when a Debugger stopped it
+int GB::System::step() {
+	if(recompiled) { //A block does everything below for each of its instructions
+		const int cycles = recompiled->run(*this);
+		if(cycles) return cycles;
+	}
+	int icycles = proc.step();
+	++instructions;
+	if(proc.profiler && proc.profiler->tick(icycles)) {
+		proc.profiler->sample(mmu.bank(proc.regs.PC) << 16 | proc.regs.PC, proc.regs.SP);
+	}
+	gpu.step((icycles - proc.gpu_stepped) >> sched.speed); //The GPU does not speed up in CGB double speed
+	sched.advance(icycles);
+	if(proc.debugger && proc.debugger->stopped) { //After a watched access
+		stop_cycles = icycles;
+		return 0;
+	}
+	return icycles;
+}
+
+//Emulate one frame, returns the cycles it took or 0 when step stopped. Running
+//it again after a stop finishes the frame.
+int GB::System::run_frame() {
+	if(!in_frame) {
+		input.latch();
+		frame_cycles = 0;
+	}
+	in_frame = true;
+
+	int cycles = frame_cycles;
+	while(!gpu.is_frame_done()) {
+		int icycles = step();
+		if(icycles == 0) { //Counted on when the frame is finished
+			frame_cycles = cycles + stop_cycles;
+			stop_cycles = 0;
+			return 0;
+		}
+		cycles += icycles;
+	}
+	apu.end_frame();
+	in_frame = false;
+	return cycles;
+}
+
+//Emulate at least cycles cycles, stops early when step stops. Frame
+//boundaries crossed on the way are handled as run_frame would.
+long GB::System::run_cycles(long cycles) {
+	long done = 0;
+	while(done < cycles) {
+		const int icycles = step();
+		done += icycles ? icycles : stop_cycles; //A watch stops after the instruction
+		stop_cycles = 0;
+		if(gpu.is_frame_done()) {
+			apu.end_frame();
+			input.latch();
+		}
+		if(icycles == 0) break;
+	}
+	return done;
+}
+
+//Pass nullptr to only measure. The layout only depends on the ROM (through
+//the size of its external ram), so every state of one ROM is the same size.
+size_t GB::System::save_state(uint8_t *buf) {
+	TimelineScope scope(PHASE_STATE);
+	StateWriter w(buf);
+	write_state(w);
+	const uint32_t size = w.size();
+	if(buf) memcpy(buf + 8, &size, 4);
+	return size;
+}
+
+//Offsets of the dirty tracked memories inside a state
+void GB::System::state_regions(std::vector<StateRegion> &regions) {
+	StateWriter w(nullptr);
+	regions.clear();
+	w.regions = &regions;
+	write_state(w);
+}
+
+void GB::System::write_state(StateWriter &w) {
+	w.put("GBMS", 4);
+	w.put<uint32_t>(STATE_VERSION);
+	w.put<uint32_t>(0); //Total size, patched in by save_state
+	w.put<uint32_t>(0); //Reserved
+	w.put(rom_hash);
+
+	w.begin("SCHD"); sched.save(w); w.end();
+	w.begin("CART"); cart.save(w);  w.end();
+	w.begin("GPU "); gpu.save(w);   w.end();
+	w.begin("TIMR"); timer.save(w); w.end();
+	w.begin("APU "); apu.save(w);   w.end();
+	w.begin("MMU "); mmu.save(w);   w.end();
+	w.begin("CPU "); proc.save(w);  w.end();
+	w.begin("INPT"); input.save(w); w.end();
+}
+
+bool GB::System::load_state(const uint8_t *buf, size_t size) {
+	TimelineScope scope(PHASE_STATE);
+	uint32_t version = 0;
+	uint32_t total = 0;
+	uint64_t hash = 0;
+	if(size != state_bytes || memcmp(buf, "GBMS", 4) != 0) return false;
+	memcpy(&version, buf + 4, 4);
+	memcpy(&total, buf + 8, 4);
+	memcpy(&hash, buf + 16, 8);
+	if(version != STATE_VERSION || total != size || hash != rom_hash) return false;
+
+	StateReader r(buf, size);
+	r.pos = STATE_HEADER_SIZE;
+	r.begin("SCHD"); sched.load(r); r.end();
+	r.begin("CART"); cart.load(r);  r.end();
+	r.begin("GPU "); gpu.load(r);   r.end();
+	r.begin("TIMR"); timer.load(r); r.end();
+	r.begin("APU "); apu.load(r);   r.end();
+	r.begin("MMU "); mmu.load(r);   r.end(); //After cart and GPU, it maps their banks
+	r.begin("CPU "); proc.load(r);  r.end();
+	r.begin("INPT"); input.load(r); r.end();
+
+	if(!r.ok) {
+		reset(); //A half loaded state is worse than none
+		return false;
+	}
+	in_frame = false;
+	stop_cycles = 0;
+	return true;
+}
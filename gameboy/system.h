@@ -0,0 +1,73 @@
+#pragma once
+
+#include "scheduler.h"
+#include "cart.h"
+#include "gpu.h"
+#include "timer.h"
+#include "apu.h"
+#include "mmu.h"
+#include "processor.h"
+#include "input.h"
+#include "state.h"
+#include "profile.h"
+#include "recompiled.h"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace GB {
+
+	//All mutable state of a system lives in this one object, except the
+	//external cart ram. The rom is shared between clones.
+	struct System {
+		GB::Scheduler sched;
+		GB::Cart cart;
+		GB::GPU gpu;
+		GB::Timer timer;
+		GB::APU apu;
+		GB::MMU mmu;
+		GB::Processor proc;
+		GB::Input input;
+		uint64_t rom_hash;
+		uint64_t instructions; //Executed since construction, not part of a state
+		Recompiled *recompiled; //Runs recompiled blocks in place of decode when set
+		bool block_jumped;      //The last block ended in a jump or call, PC is an entry
+		bool in_frame;         //A stop left run_frame halfway, input is already latched
+		int frame_cycles;      //Of that frame so far
+		int stop_cycles;       //Of the instruction a watch stopped after, it did run
+		size_t state_bytes;
+		std::vector<uint8_t> scratch; //State buffer for copy
+
+		void write_state(StateWriter &w);
+		void loaded();
+	public:
+		System();
+
+		//Page aligned, so instances on different cores never share a page
+		static void* operator new(size_t size);
+		static void operator delete(void *p);
+
+		void reset();
+		void load(const char* filename);
+		bool load(const uint8_t *data, size_t size);
+		int step();
+		int run_frame();
+		long run_cycles(long cycles);
+
+		size_t state_size() const { return state_bytes; }
+		size_t save_state(uint8_t *buf);
+		bool load_state(const uint8_t *buf, size_t size);
+		void state_regions(std::vector<StateRegion> &regions);
+		void set_profile(Profile *profile);
+		void set_guest_profiler(GuestProfiler *profiler);
+		void set_trace(Trace *trace);
+		void set_access_stats(AccessStats *stats);
+		void set_perf(PerfCounters *perf);
+		void set_latency(Latency *latency);
+		void set_recompiled(Recompiled *recompiled);
+
+		void share_rom(const System &other);
+		void copy(System &other);
+		System* clone();
+	};
+}
@@ -0,0 +1,104 @@
+#include "thread_pool.h"
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+	thread_local int worker_index = -1;
+}
+
+//With pin, worker i is bound to core i (modulo the core count)
+GB::ThreadPool::ThreadPool(int threads, bool pin) : queued(0), active(0), stopping(false) {
+	if(threads < 1) threads = 1;
+	for(int i=0;i<threads;++i) {
+		workers.push_back(new Worker());
+	}
+	for(int i=0;i<threads;++i) {
+		workers[i]->thread = std::thread(&ThreadPool::run, this, i, pin);
+	}
+}
+
+GB::ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> guard(idle_lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for(Worker *worker : workers) {
+		worker->thread.join();
+		delete worker;
+	}
+}
+
+int GB::ThreadPool::current() {
+	return worker_index;
+}
+
+void GB::ThreadPool::submit(int worker, Task task) {
+	Worker &w = *workers[worker % workers.size()];
+	{
+		std::lock_guard<std::mutex> guard(w.lock);
+		w.tasks.push_back(std::move(task));
+	}
+	{
+		std::lock_guard<std::mutex> guard(idle_lock);
+		++active;
+		++queued; //Only once the task can be popped
+	}
+	wake.notify_one();
+}
+
+//Block until every submitted task, and every task those submitted, has run
+void GB::ThreadPool::wait() {
+	std::unique_lock<std::mutex> guard(idle_lock);
+	done.wait(guard, [this] { return active == 0; });
+}
+
+//Own tasks newest first, then the oldest task of the next worker that has one
+bool GB::ThreadPool::pop(int index, Task &task) {
+	const int n = workers.size();
+	for(int k=0;k<n;++k) {
+		Worker &w = *workers[(index + k) % n];
+		std::lock_guard<std::mutex> guard(w.lock);
+		if(w.tasks.empty()) continue;
+		if(k == 0) {
+			task = std::move(w.tasks.back());
+			w.tasks.pop_back();
+		} else {
+			task = std::move(w.tasks.front());
+			w.tasks.pop_front();
+		}
+		return true;
+	}
+	return false;
+}
+
+void GB::ThreadPool::run(int index, bool pin) {
+	worker_index = index;
+#ifdef __linux__
+	if(pin) {
+		const unsigned cores = std::thread::hardware_concurrency();
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(index % (cores ? cores : 1), &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+#endif
+
+	std::unique_lock<std::mutex> guard(idle_lock);
+	for(;;) {
+		wake.wait(guard, [this] { return stopping || queued > 0; });
+		if(queued == 0) return; //Stopping and drained
+
+		--queued; //Claims one of the queued tasks, so pop finds one
+		guard.unlock();
+		Task task;
+		pop(index, task);
+		task();
+		task = nullptr;
+		guard.lock();
+
+		if(--active == 0) done.notify_all();
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace GB {
+
+	//Fixed set of workers, each with its own task deque. A worker takes its
+	//newest task first and steals the oldest task of another worker when it
+	//runs dry, so related work stays on one core until someone is idle.
+	struct ThreadPool {
+		typedef std::function<void()> Task;
+
+		struct Worker {
+			std::thread thread;
+			std::mutex lock;
+			std::deque<Task> tasks;
+		};
+
+		std::vector<Worker*> workers;
+		std::mutex idle_lock;
+		std::condition_variable wake; //Work was queued or the pool stops
+		std::condition_variable done; //Everything submitted has run
+		int queued;  //Tasks waiting in a deque, guarded by idle_lock
+		int active;  //Tasks submitted but not finished, guarded by idle_lock
+		bool stopping;
+
+		bool pop(int index, Task &task);
+		void run(int index, bool pin);
+	public:
+		ThreadPool(int threads, bool pin);
+		~ThreadPool();
+
+		int size() const { return workers.size(); }
+		void submit(int worker, Task task);
+		void wait();
+
+		static int current(); //Worker running the calling thread, -1 outside the pool
+	};
+}
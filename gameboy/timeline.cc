@@ -0,0 +1,109 @@
+#include "timeline.h"
+#include <algorithm>
+#include <mutex>
+
+namespace {
+	//Rings of all threads that ever recorded, kept after a thread exits
+	std::mutex rings_lock;
+	std::vector<GB::Timeline*> rings;
+
+	const char *phase_names[GB::PHASE_COUNT] = {
+		"frame", "input", "emulate", "ppu", "state", "rewind", "draw", "flip", "vsync", "state write",
+	};
+
+	//Oldest first
+	std::vector<GB::Timeline::Event> events(const GB::Timeline &timeline, size_t capacity) {
+		const uint64_t count = std::min<uint64_t>(timeline.head, capacity);
+		std::vector<GB::Timeline::Event> list;
+		for(uint64_t i=timeline.head-count;i<timeline.head;++i) {
+			list.push_back(timeline.ring[i & (capacity - 1)]);
+		}
+		return list;
+	}
+}
+
+std::atomic<bool> GB::Timeline::active(false);
+uint64_t GB::Timeline::epoch = 0;
+size_t GB::Timeline::capacity = 1;
+thread_local GB::Timeline *GB::Timeline::current = nullptr;
+
+GB::Timeline* GB::Timeline::attach() {
+	Timeline *timeline = new Timeline();
+	timeline->ring.resize(capacity);
+	timeline->head = 0;
+	std::lock_guard<std::mutex> guard(rings_lock);
+	timeline->tid = rings.size() + 1;
+	rings.push_back(timeline);
+	current = timeline;
+	return timeline;
+}
+
+//Start over with room for events per thread, rounded up to a power of two
+void GB::Timeline::start(size_t events) {
+	size_t size = 1;
+	while(size < events) size <<= 1;
+	active.store(false, std::memory_order_release);
+	std::lock_guard<std::mutex> guard(rings_lock);
+	capacity = size;
+	for(Timeline *timeline : rings) {
+		timeline->ring.assign(capacity, Event());
+		timeline->head = 0;
+	}
+	epoch = now();
+	active.store(true, std::memory_order_release);
+}
+
+void GB::Timeline::stop() {
+	active.store(false, std::memory_order_release);
+}
+
+//Shown as the thread name in the trace viewer
+void GB::Timeline::name_thread(const char *name) {
+	Timeline *timeline = current ? current : attach();
+	timeline->name = name;
+}
+
+//Complete ("X") events with microsecond timestamps, chrome://tracing and
+//Perfetto open the file as is
+bool GB::Timeline::write_json(const char *file) {
+	FILE *fp = fopen(file, "w");
+	if(!fp) return false;
+	fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	std::lock_guard<std::mutex> guard(rings_lock);
+	for(Timeline *timeline : rings) {
+		const std::string name = timeline->name.empty() ? "thread " + std::to_string(timeline->tid) : timeline->name;
+		fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			first ? "" : ",\n", timeline->tid, name.c_str());
+		first = false;
+		for(const Event &event : events(*timeline, capacity)) {
+			fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+				phase_names[event.phase], timeline->tid, event.start / 1000.0, event.duration / 1000.0);
+		}
+	}
+	fprintf(fp, "\n]}\n");
+	return fclose(fp) == 0;
+}
+
+//Per phase time of the events still in the rings, and the frames that took
+//longer than one at 60 Hz
+void GB::Timeline::report(FILE *fp) {
+	uint64_t count[PHASE_COUNT] = {0}, total[PHASE_COUNT] = {0}, worst[PHASE_COUNT] = {0};
+	uint64_t slow = 0;
+	std::lock_guard<std::mutex> guard(rings_lock);
+	for(Timeline *timeline : rings) {
+		for(const Event &event : events(*timeline, capacity)) {
+			++count[event.phase];
+			total[event.phase] += event.duration;
+			worst[event.phase] = std::max<uint64_t>(worst[event.phase], event.duration);
+			if(event.phase == PHASE_FRAME && event.duration > 16742706) ++slow;
+		}
+	}
+	fprintf(fp, "%-12s %10s %10s %10s\n", "phase", "events", "avg ms", "max ms");
+	for(int i=0;i<PHASE_COUNT;++i) {
+		if(!count[i]) continue;
+		fprintf(fp, "%-12s %10llu %10.3f %10.3f\n", phase_names[i], (unsigned long long)count[i],
+			total[i] / 1e6 / count[i], worst[i] / 1e6);
+	}
+	fprintf(fp, "%llu of %llu frames over 16.74 ms\n", (unsigned long long)slow, (unsigned long long)count[PHASE_FRAME]);
+}
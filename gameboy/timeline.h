@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace GB {
+
+	//What a host thread spends its time on, per frame
+	enum TimelinePhase {
+		PHASE_FRAME,       //One frame of the frontend, everything below nests in it
+		PHASE_INPUT,       //Host events and keyboard
+		PHASE_EMULATE,     //System::run_frame and run-ahead, the cpu is what PPU and state leave
+		PHASE_PPU,         //GPU::render_line
+		PHASE_STATE,       //Savestate save and load, run-ahead does two per frame
+		PHASE_REWIND,      //Rewind capture and step back
+		PHASE_DRAW,        //Scaling the picture into the window framebuffer
+		PHASE_FLIP,        //Texture upload
+		PHASE_VSYNC,       //Present, waits for vsync
+		PHASE_STATE_WRITE, //Savestate file on the saver thread
+		PHASE_COUNT
+	};
+
+	//Host timeline in Chrome trace event format, for finding the frames that
+	//stutter. Scopes only record while a Timeline is started; every thread
+	//records into its own ring and the oldest events make room for new ones.
+	//start, write_json and report touch every ring and should only run while
+	//the other threads are idle.
+	struct Timeline {
+		struct Event {
+			uint64_t start;    //ns since the timeline started
+			uint32_t duration; //ns
+			uint32_t phase;
+		};
+
+		std::vector<Event> ring;
+		uint64_t head;
+		int tid;
+		std::string name;
+
+		static std::atomic<bool> active; //Publishes epoch and capacity to recording threads
+		static uint64_t epoch;
+		static size_t capacity;
+		static thread_local Timeline *current;
+		static Timeline* attach();
+	public:
+		static inline uint64_t now() {
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		static inline bool started() {
+			return active.load(std::memory_order_acquire);
+		}
+
+		static void start(size_t events = 1 << 18);
+		static void stop();
+		static void name_thread(const char *name);
+
+		static inline void record(int phase, uint64_t start, uint64_t end) {
+			Timeline *timeline = current ? current : attach();
+			const uint64_t duration = end - start;
+			Event &event = timeline->ring[timeline->head++ & (capacity - 1)];
+			event.start = start > epoch ? start - epoch : 0;
+			event.duration = duration > UINT32_MAX ? UINT32_MAX : uint32_t(duration);
+			event.phase = phase;
+		}
+
+		static bool write_json(const char *file);
+		static void report(FILE *fp);
+	};
+
+	//Records its lifetime as one event of phase
+	struct TimelineScope {
+		int phase;
+		uint64_t start;
+	public:
+		inline TimelineScope(int phase) : phase(phase), start(Timeline::started() ? Timeline::now() : 0) {}
+		inline ~TimelineScope() {
+			if(start && Timeline::started()) Timeline::record(phase, start, Timeline::now());
+		}
+	};
+}
@@ -0,0 +1,131 @@
+#include "timer.h"
+#include "scheduler.h"
+#include "mmu.h"
+#include "state.h"
+
+GB::Timer::Timer(Scheduler &sched, MMU &mmu) : sched(sched), mmu(mmu) {
+	sched.bind(EVENT_TIMER, &Timer::overflow, this);
+	reset();
+}
+
+void GB::Timer::reset() {
+	div_base = sched.now;
+	tima_base = sched.now;
+	tima = 0;
+	tma = 0;
+	tac = 0;
+	sched.cancel(EVENT_TIMER);
+}
+
+void GB::Timer::save(StateWriter &w) {
+	w.put(div_base);
+	w.put(tima_base);
+	w.put(tima);
+	w.put(tma);
+	w.put(tac);
+}
+
+//The overflow event itself is restored with the scheduler
+void GB::Timer::load(StateReader &r) {
+	r.get(div_base);
+	r.get(tima_base);
+	r.get(tima);
+	r.get(tma);
+	r.get(tac);
+}
+
+//Cycles per TIMA increment, TIMA counts falling edges of divider bit 9/3/5/7
+unsigned GB::Timer::period() const {
+	static const unsigned periods[4] = {1024, 16, 64, 256};
+	return periods[tac & 0x03];
+}
+
+unsigned GB::Timer::divider(uint64_t at) const {
+	return (at - div_base) & 0xFFFF;
+}
+
+//Falling edges of the selected divider bit in (from, to]
+uint64_t GB::Timer::edges(uint64_t from, uint64_t to) const {
+	const uint64_t p = period();
+	return (to - div_base) / p - (from - div_base) / p;
+}
+
+void GB::Timer::increment(uint64_t n) {
+	while(n) {
+		const unsigned room = 0x100 - tima;
+		if(n < room) {
+			tima += n;
+			return;
+		}
+		n -= room;
+		tima = tma;
+		mmu.IF |= 0x04; //Timer int
+	}
+}
+
+void GB::Timer::sync(uint64_t at) {
+	if(at <= tima_base) return; //Already counted up to there
+	if(enabled()) increment(edges(tima_base, at));
+	tima_base = at;
+}
+
+void GB::Timer::reschedule() {
+	if(!enabled()) {
+		sched.cancel(EVENT_TIMER);
+		return;
+	}
+	const uint64_t p = period();
+	const uint64_t first = div_base + ((tima_base - div_base) / p + 1) * p;
+	sched.schedule(EVENT_TIMER, first + (0xFF - tima) * p);
+}
+
+void GB::Timer::overflow(void *ctx, uint64_t when) {
+	Timer *timer = static_cast<Timer*>(ctx);
+	timer->sync(when);
+	timer->reschedule();
+}
+
+uint8_t GB::Timer::read8(uint16_t addr) {
+	switch(addr) {
+		case 0xFF04: //DIV
+			return divider(sched.now) >> 8;
+		case 0xFF05: //TIMA
+			sync(sched.now);
+			return tima;
+		case 0xFF06: //TMA
+			return tma;
+		case 0xFF07: //TAC
+			return tac | 0xF8;
+	}
+	return 0; //failure state
+}
+
+void GB::Timer::write8(uint16_t addr, uint8_t value) {
+	const uint64_t now = sched.now;
+	sync(now);
+	switch(addr) {
+		case 0xFF04: //DIV
+			//Resetting the divider is a falling edge if the selected bit was set
+			if(enabled() && (divider(now) & (period() >> 1)))
+				increment(1);
+			div_base = now;
+			break;
+		case 0xFF05: //TIMA
+			tima = value;
+			break;
+		case 0xFF06: //TMA
+			tma = value;
+			break;
+		case 0xFF07: //TAC
+			{
+				//The increment signal is (enable AND selected bit), a 1->0 change ticks TIMA
+				const bool before = enabled() && (divider(now) & (period() >> 1));
+				tac = value & 0x07;
+				const bool after = enabled() && (divider(now) & (period() >> 1));
+				if(before && !after)
+					increment(1);
+			}
+			break;
+	}
+	reschedule();
+}
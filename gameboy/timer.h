@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+
+namespace GB {
+
+	struct MMU;
+	struct Scheduler;
+	struct StateWriter;
+	struct StateReader;
+
+	//DIV and TIMA are never ticked, they are derived from the scheduler's cycle
+	//count when read and TIMA overflow is scheduled as a single future event.
+	struct Timer {
+		Scheduler &sched;
+		MMU &mmu;
+		uint64_t div_base;  //Cycle at which the internal 16 bit divider was zero
+		uint64_t tima_base; //Cycle up to which tima is current
+		uint8_t tima;
+		uint8_t tma;
+		uint8_t tac;
+
+		inline bool enabled() const { return tac & 0x04; }
+		unsigned period() const;
+		unsigned divider(uint64_t at) const;
+		uint64_t edges(uint64_t from, uint64_t to) const;
+		void increment(uint64_t n);
+		void sync(uint64_t at);
+		void reschedule();
+
+		static void overflow(void *ctx, uint64_t when);
+	public:
+		Timer(Scheduler &sched, MMU &mmu);
+
+		void reset();
+		void save(StateWriter &w);
+		void load(StateReader &r);
+		uint8_t read8(uint16_t addr);
+		void write8(uint16_t addr, uint8_t value);
+	};
+}
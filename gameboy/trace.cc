@@ -0,0 +1,54 @@
+#include "trace.h"
+#include <cstdio>
+#include <cstring>
+
+GB::Trace::Trace(size_t capacity) : head(0) {
+	size_t size = 1;
+	while(size < capacity) size <<= 1;
+	ring = new TraceRecord[size](); //Zeroed, nothing writes reserved
+	mask = size - 1;
+}
+
+GB::Trace::~Trace() {
+	delete[] ring;
+}
+
+const GB::TraceRecord& GB::Trace::at(size_t i) const {
+	return ring[(head - size() + i) & mask];
+}
+
+void GB::Trace::clear() {
+	head = 0;
+}
+
+//Oldest record first, read back with the gbm_trace tool
+bool GB::Trace::dump(const char *filename) const {
+	FILE *fp = fopen(filename, "wb");
+	if(!fp) return false;
+
+	uint8_t header[TRACE_HEADER_SIZE];
+	const uint16_t version = TRACE_VERSION;
+	const uint16_t record_size = sizeof(TraceRecord);
+	const uint64_t count = size();
+	memcpy(header, "GBTR", 4);
+	memcpy(header + 4, &version, 2);
+	memcpy(header + 6, &record_size, 2);
+	memcpy(header + 8, &count, 8);
+	bool ok = fwrite(header, sizeof(header), 1, fp) == 1;
+
+	//The ring wraps at most once
+	const size_t start = (head - count) & mask;
+	const size_t first = count < capacity() - start ? count : capacity() - start;
+	ok = ok && fwrite(ring + start, sizeof(TraceRecord), first, fp) == first;
+	ok = ok && fwrite(ring, sizeof(TraceRecord), count - first, fp) == count - first;
+	return fclose(fp) == 0 && ok;
+}
+
+//The cpu hit an invalid opcode
+void GB::Trace::fault() {
+	if(fault_file.empty()) return;
+	if(dump(fault_file.c_str()))
+		fprintf(stderr, "last %zu instructions written to %s\n", size(), fault_file.c_str());
+	else
+		fprintf(stderr, "could not write trace %s\n", fault_file.c_str());
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace GB {
+
+	//One executed instruction as the cpu saw it just before running it.
+	//The dump file stores these as is, little endian.
+	struct TraceRecord {
+		uint64_t cycle;    //Scheduler::now
+		uint16_t pc;
+		uint16_t bank;     //Bank mapped at pc
+		uint8_t opcode[3]; //The instruction and the bytes after it
+		uint8_t ime;
+		uint16_t af, bc, de, hl, sp;
+		uint8_t reserved[6];
+	};
+	static_assert(sizeof(TraceRecord) == 32, "trace records are dumped as is");
+
+	enum {
+		TRACE_VERSION = 1,
+		TRACE_HEADER_SIZE = 16 //"GBTR", version, record size, record count (64 bit)
+	};
+
+	//The last capacity instructions of one instance. Only the thread running
+	//the instance writes, so recording is a plain store into the ring; dump
+	//and clear while it is not running.
+	struct Trace {
+		TraceRecord *ring;
+		size_t mask;
+		uint64_t head; //Records ever written
+	public:
+		std::string fault_file; //Where fault() dumps, nothing when empty
+
+		Trace(size_t capacity = 1 << 20); //Rounded up to a power of two
+		~Trace();
+
+		inline TraceRecord& next() {
+			return ring[head++ & mask];
+		}
+
+		size_t capacity() const { return mask + 1; }
+		size_t size() const { return head < mask + 1 ? head : mask + 1; }
+		const TraceRecord& at(size_t i) const; //0 is the oldest kept
+
+		void clear();
+		bool dump(const char *filename) const;
+		void fault();
+	};
+}
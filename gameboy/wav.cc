@@ -0,0 +1,64 @@
+#include "wav.h"
+
+namespace {
+	void put16(uint8_t *p, uint16_t v) {
+		p[0] = v & 0xFF;
+		p[1] = v >> 8;
+	}
+
+	void put32(uint8_t *p, uint32_t v) {
+		put16(p, v & 0xFFFF);
+		put16(p + 2, v >> 16);
+	}
+}
+
+GB::WavWriter::WavWriter() : fp(nullptr), frames(0), rate(0) {
+}
+
+GB::WavWriter::~WavWriter() {
+	close();
+}
+
+bool GB::WavWriter::open(const char *filename, int sample_rate) {
+	close();
+	fp = fopen(filename, "wb");
+	if(!fp) return false;
+	frames = 0;
+	rate = sample_rate;
+	write_header();
+	return true;
+}
+
+void GB::WavWriter::write_header() {
+	const uint32_t data_size = frames * 4;
+	uint8_t h[44];
+	h[0] = 'R'; h[1] = 'I'; h[2] = 'F'; h[3] = 'F';
+	put32(h + 4, 36 + data_size);
+	h[8] = 'W'; h[9] = 'A'; h[10] = 'V'; h[11] = 'E';
+	h[12] = 'f'; h[13] = 'm'; h[14] = 't'; h[15] = ' ';
+	put32(h + 16, 16);       //fmt chunk size
+	put16(h + 20, 1);        //PCM
+	put16(h + 22, 2);        //Channels
+	put32(h + 24, rate);
+	put32(h + 28, rate * 4); //Byte rate
+	put16(h + 32, 4);        //Block align
+	put16(h + 34, 16);       //Bits per sample
+	h[36] = 'd'; h[37] = 'a'; h[38] = 't'; h[39] = 'a';
+	put32(h + 40, data_size);
+	fseek(fp, 0, SEEK_SET);
+	fwrite(h, 1, sizeof(h), fp);
+}
+
+void GB::WavWriter::write(const int16_t *samples, size_t count) {
+	if(!fp) return;
+	//Samples are written as stored, WAV is little endian like our hosts
+	fwrite(samples, 4, count, fp);
+	frames += count;
+}
+
+void GB::WavWriter::close() {
+	if(!fp) return;
+	write_header();
+	fclose(fp);
+	fp = nullptr;
+}
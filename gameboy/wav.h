@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+
+namespace GB {
+
+	//16 bit stereo PCM sink, the header sizes are patched in on close
+	struct WavWriter {
+		FILE *fp;
+		uint32_t frames;
+		int rate;
+
+		void write_header();
+	public:
+		WavWriter();
+		~WavWriter();
+
+		bool open(const char *filename, int sample_rate);
+		void write(const int16_t *samples, size_t count);
+		void close();
+		bool is_open() const { return fp != nullptr; }
+	};
+}
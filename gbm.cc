@@ -1,82 +1,430 @@
-#include "gameboy/cart.h"
-#include "gameboy/mmu.h"
-#include "gameboy/processor.h"
-#include "gameboy/gpu.h"
-#include "gameboy/input.h"
+#include "gameboy/system.h"
+#include "gameboy/wav.h"
+#include "gameboy/movie.h"
+#include "gameboy/state_saver.h"
+#include "gameboy/rewind.h"
+#include "gameboy/run_ahead.h"
+#include "gameboy/runner.h"
+#include "gameboy/shm_server.h"
+#include "gameboy/opcode_stats.h"
+#include "gameboy/guest_profiler.h"
+#include "gameboy/trace.h"
+#include "gameboy/debugger.h"
+#include "gameboy/access_stats.h"
+#include "gameboy/timeline.h"
+#include "gameboy/perf_counters.h"
+#include "gameboy/latency.h"
 #include "IO.h"
 #include <SDL.h>
 #include <cstdio>
 #include <cstdint>
 #include <cassert>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <string>
+#include <vector>
 
-namespace GB {
+struct Key {
+	SDL_Scancode scancode;
+	uint8_t button;
+};
 
-	struct System {
-		GB::Cart cart;
-		GB::GPU gpu;
-		GB::MMU mmu;
-		GB::Processor proc;
-		GB::Input input;
-		IO &io;
-		uint32_t prev;
-		uint32_t cycle_count;
-		uint32_t clock;
-	public:
-		System(IO &io) : io(io), gpu(mmu), mmu(cart,gpu,input), proc(mmu) {
-			prev = SDL_GetTicks();
+const Key keys[] = {
+	{SDL_SCANCODE_RIGHT,  GB::BUTTON_RIGHT},
+	{SDL_SCANCODE_LEFT,   GB::BUTTON_LEFT},
+	{SDL_SCANCODE_UP,     GB::BUTTON_UP},
+	{SDL_SCANCODE_DOWN,   GB::BUTTON_DOWN},
+	{SDL_SCANCODE_Z,      GB::BUTTON_A},
+	{SDL_SCANCODE_X,      GB::BUTTON_B},
+	{SDL_SCANCODE_RETURN, GB::BUTTON_SELECT},
+	{SDL_SCANCODE_SPACE,  GB::BUTTON_START},
+};
+
+//Button of a key, 0 for keys that are not mapped
+uint8_t key_button(SDL_Scancode scancode) {
+	for(const Key &key : keys) {
+		if(key.scancode == scancode) return key.button;
+	}
+	return 0;
+}
+
+//Live keyboard state, sampled once per frame
+struct KeyboardSource : GB::InputSource {
+	uint8_t poll() {
+		const uint8_t *state = SDL_GetKeyboardState(NULL);
+		uint8_t buttons = 0;
+		for(const Key &key : keys) {
+			if(state[key.scancode]) buttons |= key.button;
+		}
+		return buttons;
+	}
+};
+
+//Presents frames from a System in the SDL window and handles host events
+struct Frontend {
+	GB::System &system;
+	IO &io;
+	GB::Rewind *rewind; //nullptr while a movie is recorded or played
+	bool movie;         //States cannot be loaded either then, a movie starts at power-on
+	GB::RunAhead &run_ahead;
+	GB::StateSaver saver;
+	std::vector<uint8_t> state;
+	char state_file[1024];
+	uint32_t prev;
+	uint32_t cycle_count;
+	uint32_t clock;
+	uint32_t worst; //Longest frame in ms since the title was last set
+public:
+	GB::Latency *latency; //Follows key presses to the screen when set
+
+	Frontend(GB::System &system, IO &io, GB::Rewind *rewind, GB::RunAhead &run_ahead, const char *rom) : system(system), io(io), rewind(rewind), run_ahead(run_ahead) {
+		movie = false;
+		snprintf(state_file, sizeof(state_file), "%s.state", rom);
+		prev = SDL_GetTicks();
+		cycle_count = 0;
+		clock = 0;
+		worst = 0;
+		latency = nullptr;
+	}
+
+	void save_state() {
+		state.resize(system.state_size());
+		system.save_state(state.data());
+		saver.write(state_file, state.data(), state.size());
+	}
+
+	void load_state() {
+		if(movie) {
+			fprintf(stderr, "states cannot be loaded during a movie\n");
+			return;
 		}
+		saver.flush();
+		FILE *fp = fopen(state_file, "rb");
+		if(!fp) return;
+		state.resize(system.state_size());
+		size_t size = fread(state.data(), 1, state.size(), fp);
+		fclose(fp);
+		if(!system.load_state(state.data(), size))
+			fprintf(stderr, "could not load state %s\n", state_file);
+	}
 
-		bool step() {
+	bool step() {
+		GB::TimelineScope frame(GB::PHASE_FRAME);
+		{
+			GB::TimelineScope scope(GB::PHASE_INPUT);
 			SDL_Event event;
 			while(SDL_PollEvent(&event)) {
 				switch(event.type) {
 					case SDL_QUIT:
 						return false;
+					case SDL_KEYDOWN:
+						if(event.key.keysym.scancode == SDL_SCANCODE_F5) save_state();
+						if(event.key.keysym.scancode == SDL_SCANCODE_F7) load_state();
+						if(latency && !event.key.repeat) latency->event(key_button(event.key.keysym.scancode));
+						break;
 				}
 			}
+		}
 
-			int cycles = 0;
-			while(!gpu.is_frame_done()) {
-				input.step();
-				int icycles = proc.step();
-				gpu.step(icycles);
-				cycles += icycles;
-				if(icycles == 0) return 0;
-			}
-			
+		//Holding backspace rewinds. Go back two captures and run one to have a picture.
+		if(rewind && SDL_GetKeyboardState(NULL)[SDL_SCANCODE_BACKSPACE]) {
+			if(rewind->step_back()) rewind->step_back();
+		}
+
+		int cycles;
+		{
+			GB::TimelineScope scope(GB::PHASE_EMULATE);
+			cycles = run_ahead.run_frame();
+		}
+		if(cycles == 0) return 0;
+		if(rewind) rewind->capture();
+		if(latency) latency->frame(run_ahead.screen().framebuffer, sizeof(run_ahead.screen().framebuffer));
+
+		{
+			GB::TimelineScope scope(GB::PHASE_DRAW);
 			io.clear(White);
-			gpu.write_fb(io);
-			io.flip();
-
-			uint32_t current = SDL_GetTicks();
-			uint32_t delta = current - prev;
-			prev = current;
-
-			cycle_count += cycles;
-			clock += delta;
-			if(clock > 1000) {
-				char title[100];
-				sprintf(title, "GBM | %fMhz\n",cycle_count/(clock/1000.0)/1000000.0);
-				io.set_title(title);
-				clock = 0;
-				cycle_count = 0;
-			}
+			io.draw(run_ahead.screen().framebuffer);
+		}
+		io.flip();
+		if(latency) latency->present();
+
+		uint32_t current = SDL_GetTicks();
+		uint32_t delta = current - prev;
+		prev = current;
 
-			return cycles > 0;
+		cycle_count += cycles;
+		clock += delta;
+		if(delta > worst) worst = delta;
+		if(clock > 1000) { //The average hides single slow frames, so show the worst too
+			char title[100];
+			snprintf(title, sizeof(title), "GBM | %fMhz | worst frame %ums", cycle_count/(clock/1000.0)/1000000.0, worst);
+			io.set_title(title);
+			clock = 0;
+			cycle_count = 0;
+			worst = 0;
 		}
-	};
+
+		return cycles > 0;
+	}
+};
+
+//Run without a window until the movie (or an invalid opcode) ends and report
+//what was emulated. The frame hash makes it easy to check two runs are identical.
+//With latency every frame ends with a present on its fake clock.
+int headless(GB::System &system, GB::RunAhead &run_ahead, GB::MoviePlayer *player, long max_frames, GB::Latency *latency) {
+	uint64_t frames = 0;
+	uint64_t cycles = 0;
+	uint64_t frame_hash = GB::Movie::hash(nullptr, 0);
+
+	auto start = std::chrono::steady_clock::now();
+	while(max_frames < 0 || frames < (uint64_t)max_frames) {
+		if(player && player->done()) break;
+		GB::TimelineScope frame(GB::PHASE_FRAME);
+		int c;
+		{
+			GB::TimelineScope scope(GB::PHASE_EMULATE);
+			c = run_ahead.run_frame();
+		}
+		if(c == 0) break;
+		cycles += c;
+		++frames;
+		const GB::GPU &gpu = run_ahead.screen();
+		frame_hash = GB::Movie::hash(gpu.framebuffer, sizeof(gpu.framebuffer), frame_hash);
+		if(latency) {
+			latency->frame(gpu.framebuffer, sizeof(gpu.framebuffer));
+			latency->tick();
+			latency->present();
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("frames %llu\n", (unsigned long long)frames);
+	printf("cycles %llu\n", (unsigned long long)cycles);
+	printf("frame hash %016llx\n", (unsigned long long)frame_hash);
+	printf("time %.3fs (%.1f fps, %.2fMhz)\n", seconds, frames/seconds, cycles/seconds/1000000.0);
+	return 0;
+}
+
+//Run many copies of the rom at once without a window and report their speed
+int batch(const char *rom, int count, int threads, bool pin, long max_frames, bool perf) {
+	GB::Runner runner(threads, pin);
+	runner.perf = perf;
+	runner.add(rom, count);
+	runner.run(max_frames < 0 ? 600 : max_frames);
+
+	double slowest = 0, fastest = 0;
+	for(size_t i=0;i<runner.size();++i) {
+		const double fps = runner.fps(i);
+		if(i == 0 || fps < slowest) slowest = fps;
+		if(i == 0 || fps > fastest) fastest = fps;
+	}
+	printf("instances %zu on %d thread(s)%s\n", runner.size(), runner.pool.size(), pin ? " pinned" : "");
+	printf("frames %llu in %.3fs\n", (unsigned long long)runner.total_frames, runner.wall_seconds);
+	printf("total %.1f fps, per instance %.1f-%.1f fps\n", runner.total_fps(), slowest, fastest);
+	if(perf) { //Host events per frame, over all instances
+		GB::PerfSample total;
+		uint64_t frames = 0;
+		for(size_t i=0;i<runner.size();++i) {
+			total.add(runner.stats(i).perf.total);
+			frames += runner.stats(i).perf.frames;
+		}
+		if(!frames || !total.counts[GB::PERF_CYCLES]) {
+			printf("host counters unavailable\n");
+			return 0;
+		}
+		printf("host per frame:");
+		for(int i=0;i<GB::PERF_COUNTERS;++i) {
+			printf(" %s %llu", GB::PerfCounters::name(i), (unsigned long long)(total.counts[i] / frames));
+		}
+		printf(", ipc %.2f\n", total.ipc());
+	}
+	return 0;
+}
+
+//Hand instances of the rom to a driver in another process, see gameboy/shm.h
+int serve(const char *rom, const char *shm_name, int count, int threads, bool pin, int slots, const std::vector<gbm_shm_range> &ranges) {
+	GB::Runner runner(threads, pin);
+	runner.add(rom, count);
+	GB::ShmServer server(runner);
+	if(!server.open(shm_name, slots, ranges)) {
+		fprintf(stderr, "could not create shared memory /%s\n", shm_name);
+		return 1;
+	}
+	printf("serving %zu instance(s) on /%s\n", runner.size(), shm_name);
+	fflush(stdout);
+	while(server.step());
+	return 0;
+}
+
+//Flat profile to file, folded stacks for flame graphs to file.folded
+void write_profile(const GB::GuestProfiler &profiler, const char *file) {
+	FILE *fp = fopen(file, "w");
+	if(!fp) {
+		fprintf(stderr, "could not write profile %s\n", file);
+		return;
+	}
+	profiler.write_flat(fp);
+	fclose(fp);
+
+	const std::string folded = std::string(file) + ".folded";
+	fp = fopen(folded.c_str(), "w");
+	if(!fp) {
+		fprintf(stderr, "could not write profile %s\n", folded.c_str());
+		return;
+	}
+	profiler.write_folded(fp);
+	fclose(fp);
+}
+
+//Heatmap as text to file, as CSV to file.csv
+void write_heatmap(const GB::AccessStats &stats, const char *file) {
+	FILE *fp = fopen(file, "w");
+	if(!fp) {
+		fprintf(stderr, "could not write heatmap %s\n", file);
+		return;
+	}
+	stats.write_text(fp);
+	fclose(fp);
+
+	const std::string csv = std::string(file) + ".csv";
+	fp = fopen(csv.c_str(), "w");
+	if(!fp) {
+		fprintf(stderr, "could not write heatmap %s\n", csv.c_str());
+		return;
+	}
+	stats.write_csv(fp);
+	fclose(fp);
+}
+
+void write_timeline(const char *file) {
+	if(GB::Timeline::write_json(file)) GB::Timeline::report(stderr);
+	else fprintf(stderr, "could not write timeline %s\n", file);
+}
+
+void write_misses(const GB::Recompiled &recompiled, const char *file) {
+	if(!recompiled.write_misses(file)) fprintf(stderr, "could not write misses %s\n", file);
+}
+
+//bank:addr or addr in hex, without a bank the one mapped at addr now
+bool parse_location(GB::System &system, const char *str, uint16_t &bank, uint16_t &addr) {
+	unsigned b, a;
+	if(sscanf(str, "%x:%x", &b, &a) == 2 && a <= 0xFFFF) {
+		bank = b;
+		addr = a;
+		return true;
+	}
+	if(sscanf(str, "%x", &a) == 1 && a <= 0xFFFF) {
+		addr = a;
+		bank = system.mmu.bank(addr);
+		return true;
+	}
+	return false;
+}
+
+void print_stop(const GB::Debugger &debugger) {
+	const GB::Debugger::Hit &hit = debugger.hit;
+	if(hit.kind == GB::DEBUG_BREAK)
+		printf("breakpoint %02X:%04X\n", hit.bank, hit.addr);
+	else
+		printf("%s %02X:%04X = 0x%02X by 0x%04X\n", hit.kind == GB::WATCH_READ ? "read" : "write", hit.bank, hit.addr, hit.value, hit.pc);
+}
+
+//With GBM_OPCODE_STATS every mode ends with the opcode histogram
+void report_opcodes() {
+	GB::OpcodeStats::report(stderr);
 }
 
 int main(int argc, char* argv[]) {
-	if(SDL_Init(SDL_INIT_VIDEO) < 0) {
+	if(argc < 2) {
+		fprintf(stderr, "usage: %s rom [--wav file] [--record movie] [--play movie] [--headless] [--frames n] [--run-ahead n] [--run-ahead-instance] [--instances n] [--threads n] [--pin] [--shm name] [--slots n] [--watch addr:size] [--profile file] [--profile-period n] [--sym file] [--trace file] [--trace-size n] [--heatmap file] [--timeline file] [--timeline-size n] [--perf] [--latency] [--latency-every n] [--no-fusion] [--recompiled plugin] [--recompile-misses file]\n", argv[0]);
+		exit(1);
+	}
+
+	const char *wav_file = nullptr;
+	const char *record_file = nullptr;
+	const char *play_file = nullptr;
+	bool headless_run = false;
+	long max_frames = -1;
+	int run_ahead_frames = 0;
+	bool run_ahead_instance = false;
+	int instances = 0;
+	int threads = std::thread::hardware_concurrency();
+	bool pin = false;
+	const char *shm_name = nullptr;
+	int slots = 2;
+	std::vector<gbm_shm_range> watch;
+	const char *profile_file = nullptr;
+	int profile_period = 4096;
+	const char *sym_file = nullptr;
+	const char *trace_file = nullptr;
+	long trace_size = 1 << 20;
+	const char *heatmap_file = nullptr;
+	const char *timeline_file = nullptr;
+	long timeline_size = 1 << 18;
+	bool perf = false;
+	bool measure_latency = false;
+	int latency_every = 0;
+	bool fusion = true;
+	const char *recompiled_file = nullptr;
+	const char *misses_file = nullptr;
+	for(int i=2;i<argc;++i) {
+		     if(strcmp(argv[i], "--wav")==0 && i+1 < argc) wav_file = argv[++i];
+		else if(strcmp(argv[i], "--record")==0 && i+1 < argc) record_file = argv[++i];
+		else if(strcmp(argv[i], "--play")==0 && i+1 < argc) play_file = argv[++i];
+		else if(strcmp(argv[i], "--frames")==0 && i+1 < argc) max_frames = atol(argv[++i]);
+		else if(strcmp(argv[i], "--run-ahead")==0 && i+1 < argc) run_ahead_frames = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--run-ahead-instance")==0) run_ahead_instance = true;
+		else if(strcmp(argv[i], "--instances")==0 && i+1 < argc) instances = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--threads")==0 && i+1 < argc) threads = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--pin")==0) pin = true;
+		else if(strcmp(argv[i], "--shm")==0 && i+1 < argc) shm_name = argv[++i];
+		else if(strcmp(argv[i], "--slots")==0 && i+1 < argc) slots = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--watch")==0 && i+1 < argc) {
+			unsigned addr = 0, size = 0;
+			if(sscanf(argv[++i], "%x:%x", &addr, &size) == 2 && addr + size <= 0x10000) {
+				gbm_shm_range range = {(uint16_t)addr, (uint16_t)size};
+				watch.push_back(range);
+			}
+		}
+		else if(strcmp(argv[i], "--profile")==0 && i+1 < argc) profile_file = argv[++i];
+		else if(strcmp(argv[i], "--profile-period")==0 && i+1 < argc) profile_period = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--sym")==0 && i+1 < argc) sym_file = argv[++i];
+		else if(strcmp(argv[i], "--trace")==0 && i+1 < argc) trace_file = argv[++i];
+		else if(strcmp(argv[i], "--trace-size")==0 && i+1 < argc) trace_size = atol(argv[++i]);
+		else if(strcmp(argv[i], "--timeline")==0 && i+1 < argc) timeline_file = argv[++i];
+		else if(strcmp(argv[i], "--timeline-size")==0 && i+1 < argc) timeline_size = atol(argv[++i]);
+		else if(strcmp(argv[i], "--perf")==0) perf = true;
+		else if(strcmp(argv[i], "--latency")==0) measure_latency = true;
+		else if(strcmp(argv[i], "--latency-every")==0 && i+1 < argc) latency_every = atoi(argv[++i]);
+		else if(strcmp(argv[i], "--heatmap")==0 && i+1 < argc) heatmap_file = argv[++i];
+		else if(strcmp(argv[i], "--no-fusion")==0) fusion = false;
+		else if(strcmp(argv[i], "--recompiled")==0 && i+1 < argc) recompiled_file = argv[++i];
+		else if(strcmp(argv[i], "--recompile-misses")==0 && i+1 < argc) misses_file = argv[++i];
+		else if(strcmp(argv[i], "--headless")==0) headless_run = true;
+	}
+	if(latency_every > 0 && (play_file || record_file)) {
+		fprintf(stderr, "--latency-every presses buttons itself, it cannot be combined with --play or --record\n");
+		exit(1);
+	}
+
+	if(GB::OpcodeStats::enabled)
+		atexit(report_opcodes);
+
+	if(shm_name)
+		return serve(argv[1], shm_name, instances > 0 ? instances : 1, threads, pin, slots, watch);
+	if(instances > 0)
+		return batch(argv[1], instances, threads, pin, max_frames, perf);
+
+	if(!headless_run && SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) < 0) {
 		fprintf(stderr,"sdl initialization failed: %s\b", SDL_GetError());
 		exit(1);
 	}
 
 	IO io;
-	io.create();
+	if(!headless_run) io.create();
 
-	GB::System system(io);
+	GB::System system;
 	//system.cart.load("/Users/darksecond/build/gbm/tetris.gb"); //ROM ONLY
 	//system.cart.load("../zelda.gb"); //ROM+MBC1+RAM+BATT
 	//system.cart.load("../pkmn_blue.gb"); //ROM+MBC3+RAM+BATT
@@ -84,8 +432,102 @@ int main(int argc, char* argv[]) {
 	//system.cart.load("../zelda_dx.gbc"); //ROM+MBC5+RAM+BATT
 	//system.cart.load("../ff_legend.gb"); //ROM+MBC2+BATT
 	//system.cart.load("../opus5.gb");
-	system.cart.load(argv[1]);
+	system.load(argv[1]);
+	system.proc.fusion = fusion;
+	const uint64_t rom_hash = system.rom_hash;
+
+	GB::GuestProfiler profiler(profile_period);
+	if(sym_file && !profiler.load_symbols(sym_file))
+		fprintf(stderr, "could not load symbols %s\n", sym_file);
+	if(profile_file)
+		system.set_guest_profiler(&profiler);
+
+	//Dumped when the cpu hits an invalid opcode or on the trace command
+	std::unique_ptr<GB::Trace> trace;
+	if(trace_file) {
+		trace.reset(new GB::Trace(trace_size > 0 ? trace_size : 1));
+		trace->fault_file = trace_file;
+		system.set_trace(trace.get());
+	}
+
+	//Blocks from tools/gbm_recompile, misses are seeds for its next run
+	GB::Recompiled recompiled;
+	if(recompiled_file) {
+		std::string error;
+		if(recompiled.load(recompiled_file, rom_hash, error)) {
+			recompiled.log_misses(misses_file != nullptr);
+			system.set_recompiled(&recompiled);
+		} else {
+			fprintf(stderr, "could not load %s: %s\n", recompiled_file, error.c_str());
+		}
+	}
+
+	//Slows every access down, so only attached when asked for
+	GB::AccessStats access_stats;
+	if(heatmap_file)
+		system.set_access_stats(&access_stats);
+
+	//The most recent events of every thread, written on exit or the timeline command
+	if(timeline_file) {
+		GB::Timeline::name_thread("main");
+		GB::Timeline::start(timeline_size > 0 ? timeline_size : 1);
+	}
+
+	KeyboardSource keyboard;
+	system.input.source = &keyboard;
+	if(!headless_run) system.apu.ring = &io.audio;
+
+	GB::WavWriter wav;
+	if(wav_file && wav.open(wav_file, GB::APU::sample_rate))
+		system.apu.wav = &wav;
+
+	GB::Movie movie;
+	GB::MovieRecorder recorder(movie, &keyboard);
+	GB::MoviePlayer player(movie);
+	if(play_file) {
+		if(!movie.load(play_file)) {
+			fprintf(stderr, "could not load movie %s\n", play_file);
+			exit(1);
+		}
+		if(movie.rom_hash != rom_hash) {
+			fprintf(stderr, "movie %s was recorded with a different rom\n", play_file);
+			exit(1);
+		}
+		system.input.source = &player;
+	} else if(record_file) {
+		movie.rom_hash = rom_hash;
+		system.input.source = &recorder;
+	}
+
+	GB::RunAhead run_ahead(system, run_ahead_frames, run_ahead_instance ? argv[1] : nullptr);
+
+	//Headless needs the synthetic presses, the window measures the keyboard
+	GB::Latency latency;
+	GB::LatencyDriver latency_driver(latency, latency_every);
+	if(latency_every > 0) {
+		measure_latency = true;
+		latency.use_fake_clock();
+		system.input.source = &latency_driver;
+	}
+	if(measure_latency)
+		run_ahead.set_latency(&latency);
+
+	if(headless_run) {
+		int status = headless(system, run_ahead, play_file ? &player : nullptr, max_frames, measure_latency ? &latency : nullptr);
+		if(measure_latency) latency.report(stderr);
+		if(record_file && !play_file) movie.save(record_file);
+		if(profile_file) write_profile(profiler, profile_file);
+		if(heatmap_file) write_heatmap(access_stats, heatmap_file);
+		if(timeline_file) write_timeline(timeline_file);
+		if(misses_file) write_misses(recompiled, misses_file);
+		return status;
+	}
 	
+	GB::Rewind rewind(system, 16*1024*1024, 60*60); //A minute, usually a few MB
+	Frontend frontend(system, io, (play_file || record_file) ? nullptr : &rewind, run_ahead, argv[1]);
+	frontend.movie = play_file || record_file;
+	if(measure_latency) frontend.latency = &latency;
+	std::unique_ptr<GB::Debugger> debugger; //Only attached once a breakpoint or watch is set
 	bool running = true;
 	while(running) {
 
@@ -97,13 +539,73 @@ int main(int argc, char* argv[]) {
 		} else if(strcmp(str, "show")==0) {
 			system.proc.print();
 		} else if(strcmp(str, "step")==0) {
+			const bool fusion = system.proc.fusion; //One instruction, not a whole loop
+			system.proc.fusion = false;
 			system.proc.step();
+			system.proc.fusion = fusion;
 			system.proc.print();
+		} else if(strcmp(str, "save")==0) {
+			frontend.save_state();
+		} else if(strcmp(str, "load")==0) {
+			frontend.load_state();
+		} else if(strcmp(str, "trace")==0) {
+			if(!trace) printf("start with --trace file\n");
+			else if(trace->dump(trace_file)) printf("last %zu instructions written to %s\n", trace->size(), trace_file);
+			else printf("could not write trace %s\n", trace_file);
+		} else if(strcmp(str, "profile")==0) {
+			profiler.write_flat(stdout, 30);
+		} else if(strcmp(str, "heatmap")==0) {
+			if(!heatmap_file) printf("start with --heatmap file\n");
+			else access_stats.write_text(stdout);
+		} else if(strcmp(str, "timeline")==0) {
+			if(!timeline_file) printf("start with --timeline file\n");
+			else write_timeline(timeline_file);
+		} else if(strcmp(str, "opcodes")==0) {
+			GB::OpcodeStats::report(stdout);
+		} else if(strcmp(str, "break")==0 || strcmp(str, "delete")==0) {
+			uint16_t bank, addr;
+			char where[32];
+			if(scanf("%31s", where) != 1 || !parse_location(system, where, bank, addr)) {
+				printf("usage: %s [bank:]addr\n", str);
+				continue;
+			}
+			if(!debugger) debugger.reset(new GB::Debugger(system));
+			if(str[0] == 'b') debugger->add_breakpoint(bank, addr);
+			else debugger->remove_breakpoint(bank, addr);
+		} else if(strcmp(str, "watch")==0 || strcmp(str, "rwatch")==0 || strcmp(str, "awatch")==0 || strcmp(str, "unwatch")==0) {
+			unsigned addr;
+			if(scanf("%x", &addr) != 1 || addr > 0xFFFF) {
+				printf("usage: %s addr\n", str);
+				continue;
+			}
+			if(!debugger) debugger.reset(new GB::Debugger(system));
+			     if(str[0] == 'w') debugger->add_watch(addr, 1, GB::WATCH_WRITE);
+			else if(str[0] == 'r') debugger->add_watch(addr, 1, GB::WATCH_READ);
+			else if(str[0] == 'a') debugger->add_watch(addr, 1, GB::WATCH_READ | GB::WATCH_WRITE);
+			else debugger->remove_watch(addr);
 		} else if(strcmp(str, "run")==0) {
-			while(system.step()); //Run until we come across a invalid opcode
+			if(debugger) debugger->resume();
+			while(frontend.step()); //Run until we come across a invalid opcode or a breakpoint
+			if(debugger && debugger->stopped) {
+				print_stop(*debugger);
+				system.proc.print();
+			}
 		}
 	}
 
+	if(record_file && !play_file && !movie.save(record_file))
+		fprintf(stderr, "could not save movie %s\n", record_file);
+	if(profile_file)
+		write_profile(profiler, profile_file);
+	if(heatmap_file)
+		write_heatmap(access_stats, heatmap_file);
+	if(timeline_file)
+		write_timeline(timeline_file);
+	if(misses_file)
+		write_misses(recompiled, misses_file);
+	if(measure_latency)
+		latency.report(stderr);
+
 	SDL_Quit();
 	return 0;
 }
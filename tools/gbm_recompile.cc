@@ -0,0 +1,269 @@
+//Ahead of time recompiler. Traces the code reachable from the entry point,
+//the rst and interrupt vectors and any seeds, and writes C++ with one
+//function per basic block. Built as a shared library from the same gbm tree
+//it is a plugin for Recompiled (see gameboy/recompiled.h):
+//
+//  gbm_recompile game.gb game.cc [--seeds misses.txt]
+//  c++ -std=c++11 -O2 -fPIC -shared -I<gbm> game.cc -o game.so
+//  gbm game.gb --recompiled game.so --recompile-misses misses.txt
+//
+//Tracing follows branches with a known target and bank only. Code in bank 0
+//that jumps into 0x4000-0x7FFF of a banked rom and jump tables are found
+//by running: their targets come back in the misses file, which seeds the
+//next round. Instructions the interpreter does not implement end a block
+//before them, so they still stop emulation the way decode does.
+#include "../gameboy/system.h"
+#include "../gameboy/processor_exec.h"
+#include "../gameboy/disasm.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+	struct Instruction {
+		uint16_t addr;
+		uint8_t opcode;
+		uint8_t cb;
+		int length;
+		std::string text;
+		bool store; //May write a bank register
+	};
+
+	struct Block {
+		uint16_t bank;
+		uint16_t addr;
+		bool jumps;
+		std::vector<Instruction> code;
+	};
+
+	bool is_store(uint8_t opcode, uint8_t cb, uint16_t operand) {
+		switch(opcode) {
+			case 0x02: case 0x12: case 0x22: case 0x32: //LD (rr),A
+			case 0x34: case 0x35: case 0x36:            //INC, DEC and LD (HL)
+			case 0x70: case 0x71: case 0x72: case 0x73: case 0x74: case 0x75: case 0x77: //LD (HL),r
+			case 0xC5: case 0xD5: case 0xE5: case 0xF5: //PUSH
+				return true;
+			case 0x08: case 0xEA: //LD (nn),SP and LD (nn),A
+				return operand < 0x8000;
+			case 0xCB: //Rotates, shifts, RES and SET on (HL), not BIT
+				return (cb & 0x07) == 0x06 && (cb < 0x40 || cb >= 0x80);
+			default:
+				return false;
+		}
+	}
+
+	bool is_jump(uint8_t opcode) {
+		switch(opcode) {
+			case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: //JR
+			case 0xC3: case 0xC2: case 0xCA: case 0xD2: case 0xDA: //JP
+			case 0xCD: case 0xC4: case 0xCC: case 0xD4: case 0xDC: //CALL
+			case 0xE9:                                             //JP HL
+				return true;
+			default:
+				return (opcode & 0xC7) == 0xC7; //RST
+		}
+	}
+
+	bool ends_block(uint8_t opcode) {
+		switch(opcode) {
+			case 0xC9: case 0xC0: case 0xC8: case 0xD0: case 0xD8: case 0xD9: //RET, RETI
+			case 0x76: case 0x10: //HALT, STOP
+				return true;
+			default:
+				return is_jump(opcode);
+		}
+	}
+
+	struct Recompiler {
+		const uint8_t *rom;
+		size_t size;
+		size_t banks;
+		std::set<uint32_t> seen;
+		std::deque<uint32_t> pending;
+		std::vector<Block> blocks;
+
+		void add(uint16_t bank, uint16_t addr) {
+			if(bank >= banks || addr >= 0x8000 || (addr < 0x4000 && bank != 0)) return;
+			const uint32_t key = uint32_t(bank) << 16 | addr;
+			if(seen.insert(key).second) pending.push_back(key);
+		}
+
+		//Bank of a target of code in bank, -1 when only a run can tell
+		int target_bank(uint16_t bank, uint16_t from, uint16_t target) const {
+			if(target < 0x4000) return 0;
+			if(target >= 0x8000) return -1;
+			if(from >= 0x4000) return bank;
+			return banks == 2 ? 1 : -1; //No mbc, bank 1 for good
+		}
+
+		void follow(uint16_t bank, uint16_t from, uint16_t target) {
+			const int to = target_bank(bank, from, target);
+			if(to >= 0) add(to, target);
+		}
+
+		void trace(uint16_t bank, uint16_t start) {
+			Block block = {bank, start, false, {}};
+			const size_t base = size_t(bank) * 0x4000 - (bank ? 0x4000 : 0);
+			const uint32_t end = (start | 0x3FFF) + 1;
+			uint32_t addr = start;
+			while(addr < end) {
+				if(block.code.size() == 256) { //Runs of filler, continued by another block
+					add(bank, addr);
+					break;
+				}
+				uint8_t bytes[3] = {0, 0, 0};
+				for(int i=0;i<3 && addr + i < end;++i) {
+					bytes[i] = rom[base + addr + i];
+				}
+				char text[32];
+				const int length = GB::disassemble(bytes, addr, text, sizeof(text));
+				const uint8_t opcode = bytes[0];
+				if(addr + length > end || !GB::implemented_ops[opcode] || (opcode == 0xCB && !GB::implemented_cb_ops[bytes[1]])) break;
+				const uint16_t operand = bytes[1] | bytes[2] << 8;
+				block.code.push_back(Instruction{uint16_t(addr), opcode, bytes[1], length, text, is_store(opcode, bytes[1], operand)});
+				addr += length;
+
+				if(opcode == 0x18 || (opcode & 0xE7) == 0x20) { //JR
+					follow(bank, addr, addr + int8_t(bytes[1]));
+				} else if(opcode == 0xC3 || (opcode & 0xE7) == 0xC2 || opcode == 0xCD || (opcode & 0xE7) == 0xC4) { //JP, CALL
+					follow(bank, addr, operand);
+				} else if((opcode & 0xC7) == 0xC7) { //RST
+					add(0, opcode & 0x38);
+				}
+				if(ends_block(opcode)) {
+					block.jumps = is_jump(opcode);
+					//Not taken, returned to or woken up
+					const bool falls = opcode != 0x18 && opcode != 0xC3 && opcode != 0xC9 && opcode != 0xD9 && opcode != 0xE9;
+					if(falls && addr < end) add(bank, addr);
+					break;
+				}
+			}
+			if(!block.code.empty()) blocks.push_back(block);
+		}
+
+		void run() {
+			while(!pending.empty()) {
+				const uint32_t key = pending.front();
+				pending.pop_front();
+				trace(key >> 16, key & 0xFFFF);
+			}
+		}
+	};
+
+	void write_block(FILE *fp, const Block &block) {
+		fprintf(fp, "\tint b%02X_%04X(System &s) { //%02X:%04X\n", block.bank, block.addr, block.bank, block.addr);
+		fprintf(fp, "\t\tint cycles = 0;\n");
+		for(size_t i=0;i<block.code.size();++i) {
+			const Instruction &in = block.code[i];
+			const bool last = i + 1 == block.code.size();
+			std::string check = "if(step<0x" + std::string(1, "0123456789ABCDEF"[in.opcode >> 4]) + "0123456789ABCDEF"[in.opcode & 0x0F] + ">(s, cycles)";
+			if(in.store && block.addr >= 0x4000) {
+				char bank[32];
+				snprintf(bank, sizeof(bank), " || switched(s, 0x%02X)", block.bank);
+				check += bank;
+			}
+			fprintf(fp, "\t\ts.proc.regs.PC = 0x%04X; ", in.addr + 1);
+			if(last) fprintf(fp, "%s;", check.substr(3).c_str());
+			else fprintf(fp, "%s) return cycles;", check.c_str());
+			fprintf(fp, " //%s\n", in.text.c_str());
+		}
+		fprintf(fp, "\t\treturn cycles;\n\t}\n\n");
+	}
+
+	bool write(const char *file, const char *rom_name, uint64_t rom_hash, const std::vector<Block> &blocks) {
+		FILE *fp = fopen(file, "w");
+		if(!fp) return false;
+		fprintf(fp, "//Generated by gbm_recompile from %s, build it as a shared library from\n", rom_name);
+		fprintf(fp, "//the gbm tree it was generated with. PC is set past each opcode, as\n");
+		fprintf(fp, "//decode leaves it.\n");
+		fprintf(fp, "#include \"gameboy/recompiled_block.h\"\n\n");
+		fprintf(fp, "namespace {\n");
+		fprintf(fp, "\tusing GB::System;\n\tusing GB::Block::step;\n\tusing GB::Block::switched;\n\n");
+		for(const Block &block : blocks) {
+			write_block(fp, block);
+		}
+		fprintf(fp, "\tconst GB::RecompiledBlock blocks[] = {\n");
+		for(const Block &block : blocks) {
+			fprintf(fp, "\t\t{0x%02X, 0x%04X, %s, b%02X_%04X},\n", block.bank, block.addr, block.jumps ? "true" : "false", block.bank, block.addr);
+		}
+		fprintf(fp, "\t};\n}\n\n");
+		fprintf(fp, "extern \"C\" const GB::RecompiledRom gbm_recompiled = {\n");
+		fprintf(fp, "\tGB::Recompiled::version, sizeof(GB::System), 0x%016llXull, sizeof(blocks) / sizeof(blocks[0]), blocks\n};\n",
+			(unsigned long long)rom_hash);
+		return fclose(fp) == 0;
+	}
+}
+
+int main(int argc, char *argv[]) {
+	const char *rom_file = nullptr;
+	const char *out_file = nullptr;
+	const char *seeds_file = nullptr;
+	bool usage = false;
+	for(int i=1;i<argc;++i) {
+		     if(strcmp(argv[i], "--seeds")==0 && i+1 < argc) seeds_file = argv[++i];
+		else if(argv[i][0] != '-' && !rom_file) rom_file = argv[i];
+		else if(argv[i][0] != '-' && !out_file) out_file = argv[i];
+		else usage = true;
+	}
+	if(!rom_file || !out_file || usage) {
+		fprintf(stderr, "usage: %s rom out.cc [--seeds file]\n", argv[0]);
+		return 2;
+	}
+
+	FILE *fp = fopen(rom_file, "rb");
+	if(!fp) {
+		fprintf(stderr, "could not open %s\n", rom_file);
+		return 1;
+	}
+	std::vector<uint8_t> data;
+	uint8_t buffer[1 << 16];
+	size_t n;
+	while((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+		data.insert(data.end(), buffer, buffer + n);
+	}
+	fclose(fp);
+	GB::System *system = new GB::System();
+	if(!system->load(data.data(), data.size())) {
+		fprintf(stderr, "%s is not a rom\n", rom_file);
+		return 1;
+	}
+
+	Recompiler recompiler;
+	recompiler.rom = system->cart.rom;
+	recompiler.size = system->cart.rom_size;
+	recompiler.banks = system->cart.rom_size / 0x4000;
+	recompiler.add(0, 0x0100);
+	for(int vector=0x00;vector<=0x60;vector+=8) {
+		recompiler.add(0, vector);
+	}
+	if(seeds_file) {
+		FILE *seeds = fopen(seeds_file, "r");
+		if(!seeds) {
+			fprintf(stderr, "could not open %s\n", seeds_file);
+			return 1;
+		}
+		unsigned bank, addr;
+		while(fscanf(seeds, "%x:%x", &bank, &addr) == 2) {
+			recompiler.add(bank, addr);
+		}
+		fclose(seeds);
+	}
+	recompiler.run();
+
+	if(!write(out_file, rom_file, system->rom_hash, recompiler.blocks)) {
+		fprintf(stderr, "could not write %s\n", out_file);
+		return 1;
+	}
+	size_t instructions = 0;
+	for(const Block &block : recompiler.blocks) {
+		instructions += block.code.size();
+	}
+	printf("%zu blocks, %zu instructions written to %s\n", recompiler.blocks.size(), instructions, out_file);
+	delete system;
+	return 0;
+}
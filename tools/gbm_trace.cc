@@ -0,0 +1,64 @@
+//Turns a trace dump (see gameboy/trace.h) into text, one instruction per
+//line, oldest first:
+//
+//  cycle  bank:pc  bytes  instruction  registers  ime
+#include "../gameboy/trace.h"
+#include "../gameboy/disasm.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char *argv[]) {
+	const char *file = nullptr;
+	uint64_t last = 0;
+	bool usage = false;
+	for(int i=1;i<argc;++i) {
+		     if(strcmp(argv[i], "--last")==0 && i+1 < argc) last = strtoull(argv[++i], nullptr, 10);
+		else if(argv[i][0] != '-' && !file) file = argv[i];
+		else usage = true;
+	}
+	if(!file || usage) {
+		fprintf(stderr, "usage: %s trace [--last n]\n", argv[0]);
+		return 2;
+	}
+
+	FILE *fp = fopen(file, "rb");
+	if(!fp) {
+		fprintf(stderr, "could not open %s\n", file);
+		return 1;
+	}
+	uint8_t header[GB::TRACE_HEADER_SIZE];
+	uint16_t version = 0, record_size = 0;
+	uint64_t count = 0;
+	if(fread(header, sizeof(header), 1, fp) == 1) {
+		memcpy(&version, header + 4, 2);
+		memcpy(&record_size, header + 6, 2);
+		memcpy(&count, header + 8, 8);
+	}
+	if(memcmp(header, "GBTR", 4) != 0 || version != GB::TRACE_VERSION || record_size != sizeof(GB::TraceRecord)) {
+		fprintf(stderr, "%s is not a version %d trace\n", file, GB::TRACE_VERSION);
+		fclose(fp);
+		return 1;
+	}
+
+	if(last && last < count) {
+		fseek(fp, (count - last) * sizeof(GB::TraceRecord), SEEK_CUR);
+		count = last;
+	}
+
+	GB::TraceRecord r;
+	char text[32];
+	for(uint64_t i=0;i<count && fread(&r, sizeof(r), 1, fp) == 1;++i) {
+		const int length = GB::disassemble(r.opcode, r.pc, text, sizeof(text));
+		char bytes[9] = "";
+		int at = 0;
+		for(int b=0;b<length;++b) {
+			at += snprintf(bytes + at, sizeof(bytes) - at, b ? " %02X" : "%02X", r.opcode[b]);
+		}
+		printf("%12llu  %02X:%04X  %-8s  %-16s  AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X%s\n",
+			(unsigned long long)r.cycle, r.bank, r.pc, bytes, text,
+			r.af, r.bc, r.de, r.hl, r.sp, r.ime ? " ime" : "");
+	}
+	fclose(fp);
+	return 0;
+}
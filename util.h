@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstdint>
+#include <cstddef>
+
 template<unsigned bitno, unsigned nbits=1, typename T=uint8_t>
 struct RegBit
 {
@@ -15,3 +18,21 @@ struct RegBit
 	RegBit& operator++ ()     { return *this = *this + 1; }
 	unsigned operator++ (int) { unsigned r = *this; ++*this; return r; }
 };
+
+struct RGB {
+	uint8_t r, g, b;
+};
+
+constexpr RGB Black = {0,0,0};
+constexpr RGB White = {255,255,255};
+
+//FNV-1a, for ROM and frame hashes
+inline uint64_t fnv1a(const void *data, size_t size, uint64_t h = 0xCBF29CE484222325ull)
+{
+	const uint8_t *p = static_cast<const uint8_t*>(data);
+	for(size_t i=0;i<size;++i) {
+		h ^= p[i];
+		h *= 0x100000001B3ull;
+	}
+	return h;
+}